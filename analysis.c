@@ -0,0 +1,105 @@
+#include <math.h>       // pow
+
+#include "real.h"
+#include "dsp.h"
+#include "analysis.h"
+
+// builds a simple triangular window for an fft of size n
+void analysis_window(struct analysis_t *a, int n)
+{
+    int i;
+    a->n = n;
+    for (i = 0; i < n; i++) {
+        a->window[i] = (2 * i < n) ? (2 * i) : (2 * n - 2 * i);
+    }
+}
+
+// maps columns to runs of bins growing exponentially in size, starting at bin 'first', a doubling every tenth
+// of the columns (8 columns for 80) and scaled so any number of columns covers about the same frequencies as 80;
+// the sizes scale with the fft size so the columns cover the same frequencies
+void analysis_log_columns(struct analysis_t *a, int columns, int first)
+{
+    int x;
+    int index = first;
+    double per_doubling = columns / 10.0;
+    double scale = (pow(2.0, 1 / per_doubling) - 1) / (pow(2.0, 1 / 8.0) - 1);
+    for (x = 0; x < columns; x++) {
+        int size = pow(2.0, x / per_doubling) * a->n / (20.0 * 2048) * scale;
+        if (size < 1) {
+            size = 1;
+        }
+        if (index + size > a->n / 2) {
+            // very wide panels run out of bins at small fft sizes, the last columns show the highest bins
+            index = a->n / 2 - size;
+        }
+        a->band[x].start = index;
+        a->band[x].count = size;
+        a->band[x].weight = 1.0;
+        index += size;
+    }
+    a->nbands = columns;
+    a->end = index;
+}
+
+// maps rows to the 8 octaves from bin n/1024 (about 43 Hz for a 2048 fft at 44.1 kHz), one octave per row for
+// 8 rows, otherwise equal fractions of octaves
+void analysis_octaves(struct analysis_t *a, int rows)
+{
+    int y;
+    int first = a->n / 1024;
+    int index = first;
+    for (y = 0; y < rows; y++) {
+        int end = first * pow(2.0, 8.0 * (y + 1) / rows) + 0.5;
+        if (end <= index) {
+            end = index + 1;
+        }
+        a->band[y].start = index;
+        a->band[y].count = end - index;
+        a->band[y].weight = 1.0;
+        index = end;
+    }
+    a->nbands = rows;
+    a->end = index;
+}
+
+// sets up nlevels display levels, level h being shown when gain * sqrt(sqrt(power)) >= h,
+// with power normalised to the square of the average rms
+void analysis_levels(struct analysis_t *a, int nlevels, double gain)
+{
+    int h;
+    for (h = 0; h < nlevels; h++) {
+        a->level[h] = pow(h / gain, 4.0);
+    }
+    a->nlevels = nlevels;
+}
+
+// calculates the weighted power of each band from the fft output, returns the total unweighted power
+real_t analysis_power(const struct analysis_t *a, FFTW(complex) *out, real_t power[])
+{
+    int b;
+    real_t total = 0.0;
+    for (b = 0; b < a->nbands; b++) {
+        const struct band_t *band = &a->band[b];
+        real_t sum = REAL(dsp_sum_squares)(out[band->start], 2 * band->count);
+        total += sum;
+        power[b] = band->weight * sum;
+    }
+    return total;
+}
+
+// returns the display level (0..nlevels-1) for a normalised power
+int analysis_level(const struct analysis_t *a, real_t power)
+{
+    // binary search for the highest level whose threshold is reached
+    int lo = 0;
+    int hi = a->nlevels - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (power >= a->level[mid]) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,43 @@
+/**
+ * Analysis plan for the fft visualisations, built once at startup.
+ *
+ * It holds the window table, a sparse map from display bands (spectrum columns or spectrogram octaves)
+ * to runs of fft bins with a weight, and the power thresholds of the display levels, so the per-frame
+ * work is table lookups and sums without transcendental functions.
+ **/
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "real.h"
+
+#define ANALYSIS_MAX_N      8192
+#define ANALYSIS_MAX_BANDS  1024
+#define ANALYSIS_MAX_LEVELS 256
+
+// a run of fft bins making up one display band
+struct band_t {
+    int start;      // first bin
+    int count;      // number of bins
+    real_t weight;  // weight applied to the summed power
+};
+
+struct analysis_t {
+    int n;                                  // fft size
+    real_t window[ANALYSIS_MAX_N];
+    int nbands;
+    int end;                                // one past the last bin used by the bands
+    struct band_t band[ANALYSIS_MAX_BANDS];
+    int nlevels;
+    real_t level[ANALYSIS_MAX_LEVELS];      // lowest normalised power for each display level
+};
+
+void analysis_window(struct analysis_t *a, int n);
+void analysis_log_columns(struct analysis_t *a, int columns, int first);
+void analysis_octaves(struct analysis_t *a, int rows);
+void analysis_levels(struct analysis_t *a, int nlevels, double gain);
+real_t analysis_power(const struct analysis_t *a, FFTW(complex) *out, real_t power[]);
+int analysis_level(const struct analysis_t *a, real_t power);
+
+#endif
+
@@ -0,0 +1,161 @@
+#include <stdio.h>      // fprintf, sscanf
+#include <stdlib.h>     // exit, atoi
+#include <string.h>     // strchr, strcmp
+#include <unistd.h>     // getopt
+
+#include "args.h"
+#include "output.h"
+#include "pixel.h"
+#include "geometry.h"
+#include "pool.h"
+#include "level.h"
+
+static const char *engines[] = { "fft", "mra", "iir" };
+
+// returns the analysis engine with the given name, -1 if there is none
+static int engine(const char *name)
+{
+    int i;
+    for (i = 0; i < (int)(sizeof(engines) / sizeof(engines[0])); i++) {
+        if (strcmp(name, engines[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void usage(const char *name, const struct args_t *defaults)
+{
+    fprintf(stderr, "usage: %s [options] [shm file] [seconds]\n", name);
+    if (strchr(defaults->options, 'n')) {
+        fprintf(stderr, "  -n <size>  fft size (default %d)\n", defaults->fft_n);
+    }
+    if (strchr(defaults->options, 's')) {
+        if (defaults->hop > 0) {
+            fprintf(stderr, "  -s <hop>   hop size, samples between analysis frames (default %d)\n", defaults->hop);
+        } else {
+            fprintf(stderr, "  -s <hop>   hop size, samples between analysis frames (default half the fft size)\n");
+        }
+    }
+    if (strchr(defaults->options, 'a')) {
+        fprintf(stderr, "  -a <eng>   analysis: fft, mra for shorter ffts on the higher bands, or iir for a filterbank\n"
+                        "             on the spectrogram (default %s)\n", engines[defaults->engine]);
+    }
+    if (strchr(defaults->options, 't')) {
+        fprintf(stderr, "  -t <ms>    integration time of the level, %d..%d ms (default %d)\n",
+                LEVEL_MIN_MS, LEVEL_MAX_MS, defaults->integration);
+    }
+    if (strchr(defaults->options, 'r')) {
+        fprintf(stderr, "  -r <fps>   frame rate, 0 for a frame per new block of audio (default %d)\n", defaults->fps);
+    }
+    if (strchr(defaults->options, 'e')) {
+        fprintf(stderr, "  -e <enc>   output encoding: raw or delta (default raw)\n");
+    }
+    if (strchr(defaults->options, 'f')) {
+        fprintf(stderr, "  -f <fmt>   output pixel format: rgb888, rgb565 or rgb444 (default rgb888)\n");
+    }
+    if (strchr(defaults->options, 'o')) {
+        fprintf(stderr, "  -o <file>  write frames to a shared-memory framebuffer, e.g. /dev/shm/bannervis, not stdout\n");
+    }
+    if (strchr(defaults->options, 'd')) {
+        fprintf(stderr, "  -d <dith>  dithering of packed pixels: none, bayer or temporal (default none)\n");
+    }
+    if (strchr(defaults->options, 'g')) {
+        fprintf(stderr, "  -g <WxH>   panel geometry in pixels (default %dx%d)\n", defaults->width, defaults->height);
+    }
+    if (strchr(defaults->options, 'j')) {
+        fprintf(stderr, "  -j <n>     rendering threads, 0 for all cores on panels of %d pixels or more (default 0)\n",
+                POOL_MIN_PIXELS);
+    }
+    if (strchr(defaults->options, 'i')) {
+        fprintf(stderr, "  -i <file>  render a WAV file as fast as possible instead of reading the shm file\n");
+    }
+    exit(-1);
+}
+
+// parses the command line into args, which holds the defaults on entry, exits on an invalid option
+void args_parse(struct args_t *args, int argc, char *argv[])
+{
+    if (args->width == 0) {
+        args->width = 80;
+        args->height = 8;
+    }
+    const struct args_t defaults = *args;
+    int opt;
+    while ((opt = getopt(argc, argv, args->options)) != -1) {
+        switch (opt) {
+        case 'n':
+            args->fft_n = atoi(optarg);
+            break;
+        case 's':
+            args->hop = atoi(optarg);
+            break;
+        case 'a':
+            args->engine = engine(optarg);
+            if (args->engine < 0) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 't':
+            args->integration = atoi(optarg);
+            if ((args->integration < LEVEL_MIN_MS) || (args->integration > LEVEL_MAX_MS)) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'r':
+            args->fps = atoi(optarg);
+            if (args->fps < 0) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'e':
+            args->encoding = output_encoding(optarg);
+            if (args->encoding < 0) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'f':
+            args->format = pixel_format(optarg);
+            if (args->format < 0) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'd':
+            args->dither = pixel_dither(optarg);
+            if (args->dither < 0) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'o':
+            args->output = optarg;
+            break;
+        case 'i':
+            args->input = optarg;
+            break;
+        case 'j':
+            args->threads = atoi(optarg);
+            if ((args->threads < 0) || (args->threads > POOL_MAX_THREADS)) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        case 'g':
+            if ((sscanf(optarg, "%dx%d", &args->width, &args->height) != 2) ||
+                (args->width < GEOMETRY_MIN_WIDTH) || (args->width > GEOMETRY_MAX_WIDTH) ||
+                (args->height < GEOMETRY_MIN_HEIGHT) || (args->height > GEOMETRY_MAX_HEIGHT) ||
+                (args->width * args->height > GEOMETRY_MAX_PIXELS)) {
+                usage(argv[0], &defaults);
+            }
+            break;
+        default:
+            usage(argv[0], &defaults);
+        }
+    }
+
+    // positional arguments
+    if (optind < argc) {
+        args->filename = argv[optind++];
+    }
+    if (optind < argc) {
+        args->runtime = atoi(argv[optind++]);
+    }
+}
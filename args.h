@@ -0,0 +1,38 @@
+/**
+ * Command line handling shared by the visualisations.
+ *
+ * usage: <program> [options] [shm file] [seconds]
+ * The shm file and the number of seconds to run are positional, as before, options come first.
+ * Each program lists the options it takes, as a getopt string.
+ **/
+
+#ifndef ARGS_H
+#define ARGS_H
+
+// analysis engines of the fft visualisations
+#define ENGINE_FFT      0   // one fft of the fft size
+#define ENGINE_MRA      1   // shorter ffts for higher bands, see mra.h
+#define ENGINE_IIR      2   // filterbank for the spectrogram, see bank.h
+
+struct args_t {
+    const char *options;    // getopt string of the options this program takes
+    const char *filename;   // /dev/shm file created by squeezelite
+    int runtime;            // seconds to run, 0 is forever
+    int fft_n;              // -n: fft size
+    int hop;                // -s: hop size, mono samples between analysis frames, 0 is half the fft size
+    int engine;             // -a: analysis engine, ENGINE_FFT, ENGINE_MRA or ENGINE_IIR
+    int fps;                // -r: frames per second, 0 is a frame for each new block of audio
+    int encoding;           // -e: output encoding, OUTPUT_RAW or OUTPUT_DELTA
+    int format;             // -f: output pixel format, PIXEL_RGB888, PIXEL_RGB565 or PIXEL_RGB444
+    int dither;             // -d: dithering when packing pixels, DITHER_NONE, DITHER_BAYER or DITHER_TEMPORAL
+    const char *output;     // -o: shared-memory framebuffer file to write to instead of stdout
+    const char *input;      // -i: WAV file to render offline instead of reading the shm file
+    int width;              // -g: panel geometry, width x height pixels
+    int height;
+    int threads;            // -j: rendering threads, 0 chooses from the number of cores and the panel size
+    int integration;        // -t: integration time of the level meter, in ms
+};
+
+void args_parse(struct args_t *args, int argc, char *argv[]);
+
+#endif
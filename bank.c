@@ -0,0 +1,216 @@
+#include <stdlib.h>     // malloc
+#include <string.h>     // memcpy
+#include <math.h>       // tan, atan, sqrt, pow, exp
+
+#include "real.h"
+#include "analysis.h"
+#include "stft.h"
+#include "mra.h"
+#include "bank.h"
+
+// after fftw3.h, so fftw_complex keeps its own type
+#include <complex.h>    // cexp, csqrt, cabs
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+#define MAX(x,y) ((x)>(y)?(x):(y))
+
+// added to the input of every biquad, so in silence the filter states settle on a tiny offset instead of decaying
+// into denormals, which are many times slower to compute with; far below the resolution of 16 bit audio
+#define ANTI_DENORMAL   1e-15
+
+// order of the butterworth low-pass prototype of the band-pass
+#define ORDER           BANK_SECTIONS
+
+// designs a butterworth band-pass between lo and hi cycles per sample, with unit gain at its centre: the poles
+// of the low-pass prototype are moved to the band by s -> (s^2 + w0^2) / (B s) on frequencies prewarped for the
+// bilinear transform, and each pole in the upper half plane becomes a biquad with a zero at 0 Hz and one at
+// nyquist
+static void bandpass_design(struct biquad_t section[], double lo, double hi)
+{
+    double w1 = 2 * tan(M_PI * lo);
+    double w2 = 2 * tan(M_PI * hi);
+    double w0 = sqrt(w1 * w2);
+    double bw = w2 - w1;
+    double complex z = cexp(I * 2 * atan(w0 / 2));
+    double complex gain = 1;
+    int j, k, n = 0;
+    for (k = 0; k < ORDER; k++) {
+        double complex p = cexp(I * M_PI * (2 * k + 1 + ORDER) / (2 * ORDER));
+        double complex d = csqrt(p * p * bw * bw - 4 * w0 * w0);
+        double complex root[2] = { (p * bw + d) / 2, (p * bw - d) / 2 };
+        for (j = 0; j < 2; j++) {
+            if ((cimag(root[j]) <= 0) || (n == ORDER)) {
+                continue;
+            }
+            // bw s / (s^2 + c1 s + c0) through the bilinear transform s = 2 (1 - z^-1) / (1 + z^-1)
+            double c1 = -2 * creal(root[j]);
+            double c0 = creal(root[j] * conj(root[j]));
+            double a0 = 4 + 2 * c1 + c0;
+            struct biquad_t *bq = &section[n++];
+            bq->b0 = 2 * bw / a0;
+            bq->a1 = (2 * c0 - 8) / a0;
+            bq->a2 = (4 - 2 * c1 + c0) / a0;
+            bq->z1 = 0;
+            bq->z2 = 0;
+            gain *= bq->b0 * (1 - z * z) / (z * z + bq->a1 * z + bq->a2);
+        }
+    }
+    // spread the correction of the gain at the centre over the sections
+    double correction = pow(cabs(gain), -1.0 / ORDER);
+    for (j = 0; j < ORDER; j++) {
+        section[j].b0 *= correction;
+    }
+}
+
+// sets up the filters for the bands of the analysis plan
+bool bank_init(struct bank_t *b, const struct analysis_t *a)
+{
+    int i, k;
+    if (a->nbands > BANK_MAX_BANDS) {
+        return false;
+    }
+    b->n = a->n;
+    b->nbands = a->nbands;
+    b->stages = 1;
+    b->resyncs = 0;
+    for (i = 0; i < a->nbands; i++) {
+        const struct band_t *band = &a->band[i];
+        struct bank_band_t *bb = &b->band[i];
+        int start = band->start;
+        int end = band->start + band->count;
+        if (start < 1) {
+            // no high-pass at 0 Hz
+            return false;
+        }
+
+        // the lowest rate with the band in the lower half of its band, where the decimation filters are clean
+        k = 0;
+        while ((k < BANK_STAGES - 1) && ((end << (k + 3)) <= a->n)) {
+            k++;
+        }
+        bb->stage = k;
+        b->stages = MAX(b->stages, k + 1);
+
+        // edges in cycles per sample at the rate of the stage
+        double lo = (double)(start << k) / a->n;
+        double hi = (double)(end << k) / a->n;
+        bandpass_design(bb->section, lo, hi);
+
+        // about as smooth as the fft window, but without its delay
+        double tau = MAX(a->n / 8.0, a->n / (double)start) / (1 << k);
+        bb->follow = 1 - exp(-1 / tau);
+        bb->envelope = 0;
+        bb->weight = band->weight;
+    }
+
+    // the fft of a sine of mean square p with the triangular window of height n sums to n^4 / 6 * p over the
+    // bins of its half of the spectrum
+    b->scale = (real_t)a->n * a->n * a->n * a->n / 6;
+
+    for (i = 0; i < 2; i++) {
+        b->work[i] = (real_t*) malloc(sizeof(real_t) * (MRA_TAPS - 1 + b->n));
+        if (!b->work[i]) {
+            return false;
+        }
+    }
+    bank_reset(b);
+    return true;
+}
+
+// clears the filters, envelopes and decimators
+void bank_reset(struct bank_t *b)
+{
+    int i, j;
+    for (i = 0; i < b->nbands; i++) {
+        struct bank_band_t *bb = &b->band[i];
+        for (j = 0; j < BANK_SECTIONS; j++) {
+            bb->section[j].z1 = 0;
+            bb->section[j].z2 = 0;
+        }
+        bb->envelope = 0;
+    }
+    for (i = 0; i < BANK_STAGES - 1; i++) {
+        mra_decimator_reset(&b->decimator[i]);
+    }
+}
+
+// runs count samples through the filters of a band and its envelope follower
+static void filter(struct bank_band_t *bb, const real_t *x, int count)
+{
+    struct biquad_t s[BANK_SECTIONS];
+    memcpy(s, bb->section, sizeof(s));
+    real_t envelope = bb->envelope;
+    int i, j;
+    for (i = 0; i < count; i++) {
+        real_t y = x[i];
+        for (j = 0; j < BANK_SECTIONS; j++) {
+            real_t in = y + (real_t)ANTI_DENORMAL;
+            real_t b = s[j].b0 * in;
+            y = b + s[j].z1;
+            s[j].z1 = s[j].z2 - s[j].a1 * y;
+            s[j].z2 = -b - s[j].a2 * y;
+        }
+        envelope += bb->follow * (y * y - envelope);
+    }
+    memcpy(bb->section, s, sizeof(s));
+    bb->envelope = envelope;
+}
+
+// filters count new samples at the full rate, up to n at a time
+void bank_push(struct bank_t *b, const real_t *src, int count)
+{
+    real_t *x = b->work[0] + MRA_TAPS - 1;
+    real_t *y = b->work[1] + MRA_TAPS - 1;
+    memcpy(x, src, sizeof(real_t) * count);
+    int i, k;
+    for (k = 0; (k < b->stages) && (count > 0); k++) {
+        for (i = 0; i < b->nbands; i++) {
+            if (b->band[i].stage == k) {
+                filter(&b->band[i], x, count);
+            }
+        }
+        if (k == b->stages - 1) {
+            break;
+        }
+        // the decimated samples are the input of the next stage
+        count = mra_decimate(&b->decimator[k], x, count, y);
+        real_t *t = x;
+        x = y;
+        y = t;
+    }
+}
+
+// takes the audio of the hop the stft just took, or all its history when it had to resync
+void bank_follow(struct bank_t *b, const struct stft_t *s)
+{
+    int count = s->hop;
+    if (s->resyncs != b->resyncs) {
+        bank_reset(b);
+        b->resyncs = s->resyncs;
+        count = s->n;
+    }
+    // the newest samples end at pos, in at most two contiguous pieces
+    int start = (s->pos - count + s->n) % s->n;
+    int len = MIN(count, s->n - start);
+    bank_push(b, s->history + start, len);
+    bank_push(b, s->history, count - len);
+}
+
+// returns the weighted power of each band and the total unweighted power, on the scale of the fft of size n
+real_t bank_power(const struct bank_t *b, real_t power[])
+{
+    int i;
+    real_t total = 0.0;
+    for (i = 0; i < b->nbands; i++) {
+        real_t p = b->scale * b->band[i].envelope;
+        total += p;
+        power[i] = b->band[i].weight * p;
+    }
+    return total;
+}
+
+void bank_free(struct bank_t *b)
+{
+    free(b->work[0]);
+    free(b->work[1]);
+}
@@ -0,0 +1,63 @@
+/**
+ * Streaming IIR filterbank, an alternative to the fft for the octave rows of the spectrogram.
+ *
+ * Each band of the analysis plan gets a 3rd order Butterworth band-pass between its edges, the usual octave
+ * filter of sound level meters (IEC 61260), as three cascaded biquads, and an envelope follower on the square of
+ * the output: a one-pole average with a time constant of an eighth of the fft size, or a period of the lower edge
+ * if that is longer. The bands run on the chain of half-band decimators of the multi-resolution analysis, each
+ * at the lowest rate that still has it in the lower half of its band, so an octave costs about half of the one
+ * above it and every octave filter has the same coefficients.
+ *
+ * Only the new samples are filtered, so the band energies are up to date at the end of every hop, without
+ * waiting for a window of audio to fill. They are scaled to the band powers of the fft of size n with its
+ * triangular window, so the display levels and the gain control work the same.
+ **/
+
+#ifndef BANK_H
+#define BANK_H
+
+#include <stdbool.h>
+
+#include "real.h"
+#include "analysis.h"
+#include "stft.h"
+#include "mra.h"
+
+#define BANK_STAGES     8
+#define BANK_MAX_BANDS  64
+// biquads per band, one per pole pair of the band-pass
+#define BANK_SECTIONS   3
+
+// a band-pass biquad, b0 (1 - z^-2) / (1 + a1 z^-1 + a2 z^-2), in transposed direct form II
+struct biquad_t {
+    real_t b0, a1, a2;
+    real_t z1, z2;
+};
+
+struct bank_band_t {
+    int stage;
+    struct biquad_t section[BANK_SECTIONS];
+    real_t follow;                  // envelope follower coefficient, per sample of the stage
+    real_t envelope;                // mean square of the filter output
+    real_t weight;                  // the band weight of the analysis plan
+};
+
+struct bank_t {
+    int n;                          // fft size of the analysis plan
+    int stages;                     // decimation stages in use
+    struct mra_decimator_t decimator[BANK_STAGES - 1];
+    int nbands;
+    struct bank_band_t band[BANK_MAX_BANDS];
+    real_t scale;                   // converts a mean square to the band power of the fft of size n
+    int resyncs;                    // resyncs of the stft seen so far
+    real_t *work[2];                // new samples at the rate of a stage, and of the next, after the filter tail
+};
+
+bool bank_init(struct bank_t *b, const struct analysis_t *a);
+void bank_reset(struct bank_t *b);
+void bank_push(struct bank_t *b, const real_t *src, int count);
+void bank_follow(struct bank_t *b, const struct stft_t *s);
+real_t bank_power(const struct bank_t *b, real_t power[]);
+void bank_free(struct bank_t *b);
+
+#endif
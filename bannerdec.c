@@ -0,0 +1,153 @@
+/**
+ * Reference decoder for the delta encoded frame stream described in output.h.
+ * Reads packets from stdin and writes the raw frames to stdout, e.g. "./spectrum -e delta | ./bannerdec".
+ * Deltas that arrive before the first keyframe are skipped. When the stream is corrupt, the decoder skips
+ * bytes until the next keyframe of the expected frame size, one byte at a time: the length after a stray 'K'
+ * is only peeked at, so a keyframe starting inside it is still found.
+ * Statistics about the stream are printed to stderr at the end.
+ **/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // getchar, fwrite, fprintf
+#include <stdlib.h>     // exit, atoi
+
+#include "output.h"
+
+// led banner definitions
+#define WIDTH 80
+#define HEIGHT 8
+
+static uint8_t frame[OUTPUT_MAX_SIZE];
+static uint8_t skip[OUTPUT_MAX_SIZE];
+
+// bytes put back after peeking, read again before stdin, the last one put back first
+static int ahead[2];
+static int nahead = 0;
+
+// reads a byte from stdin, returns EOF at the end of the stream
+static int get(void)
+{
+    return (nahead > 0) ? ahead[--nahead] : getchar();
+}
+
+// puts a byte back, to be read again next
+static void unget(int c)
+{
+    ahead[nahead++] = c;
+}
+
+// reads a little-endian u16 from stdin, returns -1 at the end of the stream
+static int get_u16(void)
+{
+    int lo = get();
+    int hi = get();
+    if ((lo == EOF) || (hi == EOF)) {
+        return -1;
+    }
+    return lo | (hi << 8);
+}
+
+// reads len bytes from stdin, returns false at the end of the stream
+static bool get_bytes(uint8_t *buf, int len)
+{
+    while ((nahead > 0) && (len > 0)) {
+        *buf++ = get();
+        len--;
+    }
+    return (len == 0) || (fread(buf, len, 1, stdin) == 1);
+}
+
+// argv[1] = frame size in bytes (if not present: the size of the led banner)
+int main(int argc, char *argv[])
+{
+    int size = WIDTH * HEIGHT * 3;
+    if (argc > 1) {
+        size = atoi(argv[1]);
+    }
+    if ((size <= 0) || (size > OUTPUT_MAX_SIZE)) {
+        fprintf(stderr, "usage: %s [frame size] < encoded > raw\n", argv[0]);
+        exit(-1);
+    }
+
+    bool have_key = false;
+    long frames = 0;
+    long keyframes = 0;
+    long corrupt = 0;
+    long bytes_in = 0;
+    bool in_sync = true;
+    int type;
+    while ((type = get()) != EOF) {
+        bytes_in++;
+        if (type == OUTPUT_KEYFRAME) {
+            int lo = get();
+            int hi = get();
+            if ((lo == EOF) || (hi == EOF)) {
+                break;
+            }
+            int len = lo | (hi << 8);
+            if (len != size) {
+                // not a keyframe after all, keep looking from the byte after the 'K'
+                unget(hi);
+                unget(lo);
+                corrupt += in_sync;
+                in_sync = false;
+                continue;
+            }
+            if (!get_bytes(frame, len)) {
+                break;
+            }
+            bytes_in += 2 + len;
+            have_key = true;
+            in_sync = true;
+            keyframes++;
+        } else if ((type == OUTPUT_DELTAFRAME) && in_sync) {
+            int spans = get_u16();
+            if (spans < 0) {
+                break;
+            }
+            bytes_in += 2;
+            bool valid = true;
+            int s;
+            for (s = 0; (s < spans) && valid; s++) {
+                int offset = get_u16();
+                int len = get_u16();
+                if ((offset < 0) || (len < 0)) {
+                    valid = false;
+                    break;
+                }
+                bytes_in += 4 + len;
+                if (offset + len > size) {
+                    valid = false;
+                } else if (!have_key) {
+                    // no frame to apply it to yet, consume the span
+                    valid = get_bytes(skip, len);
+                } else {
+                    valid = get_bytes(&frame[offset], len);
+                }
+            }
+            if (!valid) {
+                corrupt++;
+                in_sync = false;
+                continue;
+            }
+            if (!have_key) {
+                continue;
+            }
+        } else {
+            // out of sync, skip to the next keyframe
+            corrupt += in_sync;
+            in_sync = false;
+            continue;
+        }
+
+        fwrite(frame, size, 1, stdout);
+        fflush(stdout);
+        frames++;
+    }
+
+    fprintf(stderr, "frames=%ld, keyframes=%ld, corrupt=%ld, bytes in=%ld, raw=%ld (%.1f%%)\n",
+            frames, keyframes, corrupt, bytes_in, frames * size,
+            (frames > 0) ? 100.0 * bytes_in / (frames * size) : 0.0);
+    return 0;
+}
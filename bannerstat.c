@@ -0,0 +1,98 @@
+/**
+ * Shows the live counters that the visualisations publish in shared memory (see metrics.h).
+ * Maps the stats blocks and prints a line per visualisation every interval, with the frame rate over the
+ * interval. Blocks of processes that no longer exist, killed before they could remove them, are removed.
+ * Reading a block takes no system call, so this can poll as often as wanted without disturbing the
+ * visualisations.
+ **/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // printf
+#include <stdlib.h>     // exit, atoi
+#include <string.h>     // strcmp
+#include <time.h>       // time
+#include <unistd.h>     // unlink
+#include <sys/mman.h>   // munmap
+#include <signal.h>     // kill
+#include <errno.h>
+#include <glob.h>
+
+#include "mono.h"
+#include "metrics.h"
+
+#define MAX_BLOCKS  16
+
+// usage: bannerstat [-1] [stats file ...]
+// -1 = print once, after one interval, and exit
+// stats files = /dev/shm/bannervis-stats-<program>-<pid> files (if not present: all of them)
+int main(int argc, char *argv[])
+{
+    bool once = false;
+    int first = 1;
+    if ((argc > 1) && (strcmp(argv[1], "-1") == 0)) {
+        once = true;
+        first = 2;
+    }
+
+    glob_t g;
+    char **names = &argv[first];
+    int count = argc - first;
+    if (count == 0) {
+        if (glob("/dev/shm/bannervis-stats-*", 0, NULL, &g) != 0) {
+            fprintf(stderr, "no visualisation stats found\n");
+            exit(-1);
+        }
+        names = g.gl_pathv;
+        count = g.gl_pathc;
+    }
+
+    const struct metrics_t *block[MAX_BLOCKS];
+    struct metrics_t prev[MAX_BLOCKS];
+    int blocks = 0;
+    int i;
+    for (i = 0; (i < count) && (blocks < MAX_BLOCKS); i++) {
+        block[blocks] = metrics_map(names[i]);
+        if ((block[blocks] == NULL) || !metrics_read(block[blocks], &prev[blocks])) {
+            continue;
+        }
+        if ((kill(prev[blocks].pid, 0) < 0) && (errno == ESRCH)) {
+            // left behind by a visualisation that was killed
+            munmap((void *)block[blocks], sizeof(struct metrics_t));
+            unlink(names[i]);
+            continue;
+        }
+        blocks++;
+    }
+    if (blocks == 0) {
+        fprintf(stderr, "no visualisation stats found\n");
+        exit(-1);
+    }
+
+    int64_t next = mono_ns();
+    for (;;) {
+        next += 1000000000LL;
+        mono_sleep_until(next);
+        for (i = 0; i < blocks; i++) {
+            struct metrics_t m;
+            if (!metrics_read(block[i], &m)) {
+                continue;
+            }
+            int64_t interval = m.published - prev[i].published;
+            double fps = (interval > 0) ? (m.frames - prev[i].frames) * 1e9 / interval : 0.0;
+            const char *state = !m.running ? "stopped" :
+                                (mono_ns() - m.published > 2000000000LL) ? "stalled" : "running";
+            printf("%-12s pid=%d %s fps=%.1f frames=%llu dropped=%llu overruns=%llu torn=%llu retries=%llu "
+                   "rate=%u rms=%d age=%llds\n",
+                   m.program, m.pid, state, fps, (unsigned long long)m.frames, (unsigned long long)m.dropped,
+                   (unsigned long long)m.overruns, (unsigned long long)m.torn, (unsigned long long)m.retries,
+                   m.rate, m.rms, (long long)(time(NULL) - m.updated));
+            prev[i] = m;
+        }
+        fflush(stdout);
+        if (once) {
+            break;
+        }
+    }
+    return 0;
+}
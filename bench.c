@@ -0,0 +1,561 @@
+/**
+ * Benchmarks for the processing stages of the visualisations, runs without squeezelite.
+ *
+ * Usage: bench <name> [iterations]
+ * - xcorr: waveform matching, the FFT cross-correlation engine against the brute-force loop it replaces
+ * - simd: the vectorised kernels, checked against and timed with their scalar versions, fails (exit code 1) when
+ *   one of them differs by more than its tolerance; "make check" runs this
+ * - pack: packing frames into the reduced pixel formats, with the colour error of each kind of dithering
+ * - bands: the analysis engines of the spectrogram octaves, cost per column and how closely the displayed
+ *   levels follow those of the fft, for a few test signals
+ **/
+
+#include <stdio.h>      // printf, fprintf
+#include <stdlib.h>     // exit, atoi, rand
+#include <string.h>     // strcmp
+#include <stdbool.h>
+#include <math.h>       // sin
+
+#include "mono.h"
+#include "xcorr.h"
+#include "dsp.h"
+#include "pixel.h"
+#include "analysis.h"
+#include "cache.h"
+#include "mra.h"
+#include "bank.h"
+
+// fills buf with a test signal: a few sines plus some noise
+static void test_signal(double *buf, int n, int offset)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        int t = i + offset;
+        buf[i] = 8000.0 * sin(t * 0.031) + 3000.0 * sin(t * 0.177) + (rand() % 2000 - 1000);
+    }
+}
+
+// the brute-force matching loop used by waveformf before the correlation engine, with a tap stride
+static int brute_force_match(double *prv, double *buf, int len, int stride)
+{
+    int i, j;
+    double sum;
+    double sum_max = 0;
+    int shift = 0;
+    for (i = 0; i < len; i++) {
+        sum = 0;
+        for (j = 0; j < len; j += stride) {
+            sum += prv[j] * buf[i + j];
+        }
+        if (sum > sum_max) {
+            sum_max = sum;
+            shift = i;
+        }
+    }
+    return shift;
+}
+
+static void bench_xcorr(int iterations)
+{
+    int len;
+    printf("%8s %14s %14s %14s %8s\n", "len", "loop/16 (us)", "loop/1 (us)", "xcorr (us)", "match");
+    for (len = 1280; len <= 5120; len *= 2) {
+        double *prv = malloc(sizeof(double) * len);
+        double *buf = malloc(sizeof(double) * 2 * len);
+        test_signal(prv, len, 0);
+        test_signal(buf, 2 * len, -137);
+
+        struct xcorr_t xc;
+        if (!xcorr_init(&xc, len)) {
+            fprintf(stderr, "xcorr_init failed\n");
+            exit(-1);
+        }
+
+        int i;
+        int64_t t0 = mono_ns();
+        volatile int sink = 0;
+        for (i = 0; i < iterations; i++) {
+            sink += brute_force_match(prv, buf, len, 16);
+        }
+        int64_t t1 = mono_ns();
+        int full = 0;
+        for (i = 0; i < iterations; i++) {
+            full = brute_force_match(prv, buf, len, 1);
+        }
+        int64_t t2 = mono_ns();
+        int fast = 0;
+        for (i = 0; i < iterations; i++) {
+            memcpy(xc.ref, prv, sizeof(double) * len);
+            memcpy(xc.sig, buf, sizeof(double) * 2 * len);
+            fast = xcorr_best_shift(&xc);
+        }
+        int64_t t3 = mono_ns();
+
+        printf("%8d %14.1f %14.1f %14.1f %8s\n", len,
+               (t1 - t0) / 1e3 / iterations, (t2 - t1) / 1e3 / iterations, (t3 - t2) / 1e3 / iterations,
+               (full == fast) ? "ok" : "DIFF");
+
+        xcorr_free(&xc);
+        free(prv);
+        free(buf);
+    }
+}
+
+// returns the relative difference between a and b
+static double rel_diff(double a, double b)
+{
+    double m = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return (m > 0.0) ? fabs(a - b) / m : 0.0;
+}
+
+// returns the largest relative difference between the n values of a and b
+static double max_diff(const double *a, const double *b, int n)
+{
+    double diff = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        double d = rel_diff(a[i], b[i]);
+        diff = (d > diff) ? d : diff;
+    }
+    return diff;
+}
+
+static double max_difff(const float *a, const float *b, int n)
+{
+    double diff = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        double d = rel_diff(a[i], b[i]);
+        diff = (d > diff) ? d : diff;
+    }
+    return diff;
+}
+
+// kernels that failed the check, for the exit code
+static int failures;
+
+// prints a line of the simd table, a kernel fails when it differs from the scalar version by more than tolerance
+static void simd_report(const char *name, int64_t t0, int64_t t1, int64_t t2, int iterations, double diff,
+                        double tolerance)
+{
+    bool ok = (diff <= tolerance);
+    if (!ok) {
+        failures++;
+    }
+    printf("%-20s %12.2f %12.2f %12.2g %10.2g %6s\n", name,
+           (t1 - t0) / 1e3 / iterations, (t2 - t1) / 1e3 / iterations, diff, tolerance, ok ? "ok" : "FAIL");
+}
+
+// the double kernels only reorder the additions of a sum, the elementwise ones round the same as the scalar code
+#define TOLERANCE       1e-12
+#define TOLERANCE_F     1e-5
+
+static void bench_simd(int iterations)
+{
+    // odd length, so the scalar tail of the kernels is exercised too
+    const int n = 2047;
+    s16_t *pcm = malloc(sizeof(s16_t) * 2 * n);
+    double *win = malloc(sizeof(double) * n);
+    double *mono = malloc(sizeof(double) * n);
+    double *ref = malloc(sizeof(double) * n);
+    double *vec = malloc(sizeof(double) * n);
+    float *winf = malloc(sizeof(float) * n);
+    float *monof = malloc(sizeof(float) * n);
+    float *reff = malloc(sizeof(float) * n);
+    float *vecf = malloc(sizeof(float) * n);
+    int i;
+    for (i = 0; i < 2 * n; i++) {
+        pcm[i] = (i & 1) ? -32768 + rand() % 65536 : 32767 - rand() % 1000;
+    }
+    for (i = 0; i < n; i++) {
+        win[i] = (2 * i < n) ? (2 * i) : (2 * n - 2 * i);
+        winf[i] = win[i];
+    }
+
+    printf("kernels: %s\n", dsp_impl());
+    printf("%-20s %12s %12s %12s %10s %6s\n", "kernel", "scalar (us)", "simd (us)", "max diff", "tolerance", "check");
+
+    // downmix + window
+    dsp_downmix_window_scalar(pcm, win, ref, n);
+    dsp_downmix_window(pcm, win, vec, n);
+    double diff = max_diff(ref, vec, n);
+    int64_t t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix_window_scalar(pcm, win, ref, n);
+    }
+    int64_t t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix_window(pcm, win, vec, n);
+    }
+    int64_t t2 = mono_ns();
+    simd_report("downmix_window", t0, t1, t2, iterations, diff, TOLERANCE);
+
+    dsp_downmix_windowf_scalar(pcm, winf, reff, n);
+    dsp_downmix_windowf(pcm, winf, vecf, n);
+    diff = max_difff(reff, vecf, n);
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix_windowf_scalar(pcm, winf, reff, n);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix_windowf(pcm, winf, vecf, n);
+    }
+    t2 = mono_ns();
+    simd_report("downmix_windowf", t0, t1, t2, iterations, diff, TOLERANCE_F);
+
+    // downmix and window separately, as done by the streaming stft
+    dsp_downmix_scalar(pcm, mono, n);
+    dsp_window_scalar(mono, win, ref, n);
+    dsp_downmix(pcm, mono, n);
+    dsp_window(mono, win, vec, n);
+    diff = max_diff(ref, vec, n);
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix_scalar(pcm, mono, n);
+        dsp_window_scalar(mono, win, ref, n);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmix(pcm, mono, n);
+        dsp_window(mono, win, vec, n);
+    }
+    t2 = mono_ns();
+    simd_report("downmix, window", t0, t1, t2, iterations, diff, TOLERANCE);
+
+    dsp_downmixf_scalar(pcm, monof, n);
+    dsp_windowf_scalar(monof, winf, reff, n);
+    dsp_downmixf(pcm, monof, n);
+    dsp_windowf(monof, winf, vecf, n);
+    diff = max_difff(reff, vecf, n);
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmixf_scalar(pcm, monof, n);
+        dsp_windowf_scalar(monof, winf, reff, n);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_downmixf(pcm, monof, n);
+        dsp_windowf(monof, winf, vecf, n);
+    }
+    t2 = mono_ns();
+    simd_report("downmixf, windowf", t0, t1, t2, iterations, diff, TOLERANCE_F);
+
+    // power spectrum accumulation
+    volatile double sink = 0.0;
+    diff = rel_diff(dsp_sum_squares_scalar(ref, n), dsp_sum_squares(ref, n));
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        sink += dsp_sum_squares_scalar(ref, n);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        sink += dsp_sum_squares(ref, n);
+    }
+    t2 = mono_ns();
+    simd_report("sum_squares", t0, t1, t2, iterations, diff, TOLERANCE);
+
+    diff = rel_diff(dsp_sum_squaresf_scalar(reff, n), dsp_sum_squaresf(reff, n));
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        sink += dsp_sum_squaresf_scalar(reff, n);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        sink += dsp_sum_squaresf(reff, n);
+    }
+    t2 = mono_ns();
+    simd_report("sum_squaresf", t0, t1, t2, iterations, diff, TOLERANCE_F);
+
+    // rms, integer so it must match exactly
+    int64_t l1, r1, l2, r2;
+    dsp_sum_squares_stereo_scalar(pcm, n, &l1, &r1);
+    dsp_sum_squares_stereo(pcm, n, &l2, &r2);
+    diff = (double)(llabs(l1 - l2) + llabs(r1 - r2));
+    t0 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_sum_squares_stereo_scalar(pcm, n, &l1, &r1);
+    }
+    t1 = mono_ns();
+    for (i = 0; i < iterations; i++) {
+        dsp_sum_squares_stereo(pcm, n, &l2, &r2);
+    }
+    t2 = mono_ns();
+    simd_report("sum_squares_stereo", t0, t1, t2, iterations, diff, 0.0);
+
+    free(pcm);
+    free(win);
+    free(mono);
+    free(ref);
+    free(vec);
+    free(winf);
+    free(monof);
+    free(reff);
+    free(vecf);
+}
+
+// led banner definitions
+#define WIDTH 80
+#define HEIGHT 8
+
+// unpacks channel c of pixel i of a packed frame back to 8 bits
+static int unpack(int format, const uint8_t *p, int i, int c)
+{
+    if (format == PIXEL_RGB565) {
+        int v = p[2 * i] | (p[2 * i + 1] << 8);
+        int bits[3] = { 5, 6, 5 };
+        int shift[3] = { 11, 5, 0 };
+        int max = (1 << bits[c]) - 1;
+        return ((v >> shift[c]) & max) * 255 / max;
+    } else {
+        // 12 bits per pixel, nibble n of the frame
+        int n = 3 * i + c;
+        int nibble = (n & 1) ? (p[n / 2] & 0x0F) : (p[n / 2] >> 4);
+        return nibble * 17;
+    }
+}
+
+static void bench_pack(int iterations)
+{
+    // horizontal gradients over the banner, as drawn with the palettes
+    static uint8_t frame[HEIGHT][WIDTH][3];
+    static uint8_t packed[HEIGHT * WIDTH * 3];
+    int x, y, i, c;
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < WIDTH; x++) {
+            frame[y][x][0] = x * 255 / (WIDTH - 1);
+            frame[y][x][1] = 60 + x * 2;
+            frame[y][x][2] = 255 - y * 30;
+        }
+    }
+
+    const char *formats[] = { "rgb565", "rgb444" };
+    const char *dithers[] = { "none", "bayer", "temporal" };
+    printf("%-8s %-10s %6s %10s %12s %12s\n", "format", "dither", "bytes", "pack (us)", "frame error", "16 frames");
+    unsigned int f, d;
+    for (f = 0; f < 2; f++) {
+        for (d = 0; d < 3; d++) {
+            int format = pixel_format(formats[f]);
+            pixel_init(format, pixel_dither(dithers[d]), WIDTH, HEIGHT);
+
+            int64_t t0 = mono_ns();
+            for (i = 0; i < iterations; i++) {
+                pixel_pack(&frame[0][0][0], packed);
+            }
+            int64_t t1 = mono_ns();
+
+            // mean absolute colour error of one frame, and of the average over 16 frames
+            pixel_init(format, pixel_dither(dithers[d]), WIDTH, HEIGHT);
+            static int sum[HEIGHT * WIDTH][3];
+            double frame_error = 0.0;
+            int k;
+            memset(sum, 0, sizeof(sum));
+            for (k = 0; k < 16; k++) {
+                pixel_pack(&frame[0][0][0], packed);
+                for (i = 0; i < HEIGHT * WIDTH; i++) {
+                    for (c = 0; c < 3; c++) {
+                        int v = unpack(format, packed, i, c);
+                        sum[i][c] += v;
+                        if (k == 0) {
+                            frame_error += abs(v - frame[i / WIDTH][i % WIDTH][c]);
+                        }
+                    }
+                }
+            }
+            double avg_error = 0.0;
+            for (i = 0; i < HEIGHT * WIDTH; i++) {
+                for (c = 0; c < 3; c++) {
+                    avg_error += fabs(sum[i][c] / 16.0 - frame[i / WIDTH][i % WIDTH][c]);
+                }
+            }
+            printf("%-8s %-10s %6d %10.2f %12.2f %12.2f\n", formats[f], dithers[d], pixel_frame_size(),
+                   (t1 - t0) / 1e3 / iterations, frame_error / (HEIGHT * WIDTH * 3), avg_error / (HEIGHT * WIDTH * 3));
+        }
+    }
+}
+
+// spectrogram definitions
+#define BANDS_N         2048
+#define BANDS_HOP       882
+#define BANDS_ROWS      8
+#define BANDS_COLORS    240
+// columns before the level comparison, for the gain control to settle
+#define BANDS_WARMUP    500
+
+// fills buf with test signal s at 44.1 kHz: tones, a sweep, noise or bursts of a tone
+static void bands_signal(int s, double *buf, int n)
+{
+    int i;
+    double phase = 0.0;
+    for (i = 0; i < n; i++) {
+        double t = i / 44100.0;
+        switch (s) {
+        case 0:
+            buf[i] = 8000.0 * sin(i * 0.031) + 3000.0 * sin(i * 0.177) + (rand() % 2000 - 1000);
+            break;
+        case 1:
+            // 20 Hz to 20 kHz in 10 s
+            phase += 2 * M_PI * 20.0 * pow(1000.0, fmod(t, 10.0) / 10.0) / 44100.0;
+            buf[i] = 8000.0 * sin(phase);
+            break;
+        case 2:
+            buf[i] = rand() % 16000 - 8000;
+            break;
+        default:
+            // 1 kHz, 50 ms out of every 300 ms
+            buf[i] = (fmod(t, 0.3) < 0.05) ? 8000.0 * sin(2 * M_PI * 1000.0 * t) : 0.0;
+            break;
+        }
+    }
+}
+
+// runs engine e over the columns of the signal, storing the power of each octave, returns the time taken
+static int64_t bands_run(int e, const struct analysis_t *a, const double *x, int columns, double power[][BANDS_ROWS],
+                         double total[])
+{
+    static struct mra_t mra;
+    static struct bank_t bank;
+    double *in = fftw_malloc(sizeof(double) * BANDS_N);
+    fftw_complex *out = fftw_malloc(sizeof(fftw_complex) * (BANDS_N / 2 + 1));
+    fftw_plan plan = cache_plan_r2c(BANDS_N, in, out);
+    if (((e == 1) && !mra_init(&mra, a)) || ((e == 2) && !bank_init(&bank, a))) {
+        fprintf(stderr, "engine %d: init failed\n", e);
+        exit(-1);
+    }
+
+    int c;
+    int64_t t0 = mono_ns();
+    if (e == 1) {
+        mra_push(&mra, x, BANDS_N);
+    } else if (e == 2) {
+        bank_push(&bank, x, BANDS_N);
+    }
+    for (c = 0; c < columns; c++) {
+        // the newest sample of column c is just before sample end
+        int end = BANDS_N + c * BANDS_HOP;
+        if (e == 1) {
+            mra_push(&mra, x + end - BANDS_HOP, BANDS_HOP);
+            total[c] = mra_power(&mra, power[c]);
+        } else if (e == 2) {
+            bank_push(&bank, x + end - BANDS_HOP, BANDS_HOP);
+            total[c] = bank_power(&bank, power[c]);
+        } else {
+            dsp_window(x + end - BANDS_N, a->window, in, BANDS_N);
+            fftw_execute(plan);
+            total[c] = analysis_power(a, out, power[c]);
+        }
+    }
+    int64_t t1 = mono_ns();
+
+    if (e == 1) {
+        mra_free(&mra);
+    } else if (e == 2) {
+        bank_free(&bank);
+    }
+    fftw_destroy_plan(plan);
+    fftw_free(in);
+    fftw_free(out);
+    return t1 - t0;
+}
+
+// turns the powers into display levels, with the gain control of the spectrogram
+static void bands_levels(const struct analysis_t *a, int columns, double power[][BANDS_ROWS], const double total[],
+                         int level[][BANDS_ROWS])
+{
+    int rms_avg = 1;
+    int c, y;
+    for (c = 0; c < columns; c++) {
+        double norm = 1.0 / ((double)rms_avg * rms_avg);
+        for (y = 0; y < BANDS_ROWS; y++) {
+            level[c][y] = analysis_level(a, power[c][y] * norm);
+        }
+        double rms = sqrt(total[c] / a->end);
+        rms_avg += (rms - rms_avg) / 64;
+    }
+}
+
+static void bench_bands(int iterations)
+{
+    static struct analysis_t a;
+    analysis_window(&a, BANDS_N);
+    analysis_octaves(&a, BANDS_ROWS);
+    analysis_levels(&a, BANDS_COLORS, 50.0);
+
+    int columns = BANDS_WARMUP + iterations;
+    int n = BANDS_N + columns * BANDS_HOP;
+    double *x = malloc(sizeof(double) * n);
+    double (*power)[BANDS_ROWS] = malloc(sizeof(*power) * columns);
+    double *total = malloc(sizeof(double) * columns);
+    int (*fft)[BANDS_ROWS] = malloc(sizeof(*fft) * columns);
+    int (*level)[BANDS_ROWS] = malloc(sizeof(*level) * columns);
+
+    const char *signals[] = { "tones", "sweep", "noise", "bursts" };
+    const char *engines[] = { "fft", "mra", "iir" };
+    printf("%-8s %-6s %12s %14s %12s\n", "signal", "engine", "column (us)", "level diff", "within 5%");
+    int s, e, c, y;
+    for (s = 0; s < 4; s++) {
+        bands_signal(s, x, n);
+        for (e = 0; e < 3; e++) {
+            int64_t ns = bands_run(e, &a, x, columns, power, total);
+            bands_levels(&a, columns, power, total, (e == 0) ? fft : level);
+            if (e == 0) {
+                memcpy(level, fft, sizeof(*fft) * columns);
+            }
+
+            // mean absolute difference with the levels of the fft, and the part within 5% of the scale
+            double diff = 0.0;
+            int close = 0;
+            for (c = BANDS_WARMUP; c < columns; c++) {
+                for (y = 0; y < BANDS_ROWS; y++) {
+                    int d = abs(level[c][y] - fft[c][y]);
+                    diff += d;
+                    close += (d * 20 <= BANDS_COLORS);
+                }
+            }
+            printf("%-8s %-6s %12.2f %14.2f %11.1f%%\n", signals[s], engines[e], ns / 1e3 / columns,
+                   diff / (iterations * BANDS_ROWS), 100.0 * close / (iterations * BANDS_ROWS));
+        }
+    }
+    free(x);
+    free(power);
+    free(total);
+    free(fft);
+    free(level);
+}
+
+struct bench_t {
+    const char *name;
+    void (*run)(int iterations);
+};
+
+static const struct bench_t benches[] = {
+    { "xcorr", bench_xcorr },
+    { "simd", bench_simd },
+    { "pack", bench_pack },
+    { "bands", bench_bands },
+};
+
+// argv[1] = name of the benchmark
+// argv[2] = number of iterations (if not present: 100)
+int main(int argc, char *argv[])
+{
+    int iterations = 100;
+    if (argc > 2) {
+        iterations = atoi(argv[2]);
+    }
+
+    unsigned int i;
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if ((argc > 1) && (strcmp(argv[1], benches[i].name) == 0)) {
+            benches[i].run(iterations);
+            return (failures > 0) ? 1 : 0;
+        }
+    }
+
+    fprintf(stderr, "usage: %s <benchmark> [iterations], with benchmark one of:", argv[0]);
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        fprintf(stderr, " %s", benches[i].name);
+    }
+    fprintf(stderr, "\n");
+    return -1;
+}
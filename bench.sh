@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs each visualisation against the synthetic producer (fakesqueeze) and reports its frame rate,
+# cpu use and audio-to-frame latency.
+# usage: ./bench.sh [seconds per visualisation] [extra options for the visualisations]
+# The frames are read back as raw rgb888, so the output options -e, -f, -d and -o and the offline -i are refused;
+# -g is passed on to fakesqueeze for the frame size.
+
+DURATION=${1:-10}
+shift 2>/dev/null
+GEOMETRY=80x8
+NEXT=
+for arg in "$@"; do
+    case "$NEXT$arg" in
+    -g) NEXT=-g ;;
+    -g*) GEOMETRY=${arg#-g}; NEXT= ;;
+    -e|-e*|-f|-f*|-d|-d*|-o|-o*|-i|-i*)
+        echo "bench.sh reads raw rgb888 frames from stdout, $arg is not supported" >&2
+        exit 1 ;;
+    *) NEXT= ;;
+    esac
+done
+for vis in vumeter waveform waveformf spectrum spectrogram; do
+    printf "%-12s " $vis
+    ./fakesqueeze -s pulse -t $DURATION -g $GEOMETRY -o /dev/shm/squeezelite-bench -x "./$vis $*" 2>/dev/null
+done
+rm -f /dev/shm/squeezelite-bench
@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // snprintf, rename
+#include <stdlib.h>     // getenv
+#include <string.h>     // memcmp
+#include <unistd.h>     // write, close, getpid
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // mmap
+#include <sys/stat.h>   // mkdir, fstat
+
+#include "real.h"
+#include "cache.h"
+
+#define CACHE_MAGIC     "BVC1"
+
+// header in front of a cached blob
+struct blob_t {
+    char magic[4];
+    uint32_t key;
+    uint32_t size;
+    uint32_t real_size;
+};
+
+struct cache_stats_t cache_stats;
+
+static bool wisdom_loaded = false;
+
+// returns the cache directory, creating it if needed
+static const char *cache_dir(void)
+{
+    const char *dir = getenv("BANNERVIS_CACHE");
+    if (dir == NULL) {
+        dir = "/var/tmp/bannervis";
+    }
+    mkdir(dir, 0755);
+    return dir;
+}
+
+// builds the path of a file in the cache directory
+static void cache_path(char *path, size_t len, const char *name)
+{
+    snprintf(path, len, "%s/%s%s", cache_dir(), name, (sizeof(real_t) == sizeof(float)) ? "-f32" : "");
+}
+
+// imports the saved wisdom once
+static void wisdom_load(void)
+{
+    if (!wisdom_loaded) {
+        char path[256];
+        cache_path(path, sizeof(path), "wisdom");
+        FFTW(import_wisdom_from_filename)(path);
+        wisdom_loaded = true;
+    }
+}
+
+// counts a plan, telling whether it came from wisdom
+static void count_plan(bool from_wisdom)
+{
+    if (from_wisdom) {
+        cache_stats.plans_wisdom++;
+    } else {
+        cache_stats.plans_measured++;
+    }
+}
+
+// creates a real to complex fft plan, from wisdom if possible, by measuring otherwise
+FFTW(plan) cache_plan_r2c(int n, real_t *in, FFTW(complex) *out)
+{
+    wisdom_load();
+    FFTW(plan) plan = FFTW(plan_dft_r2c_1d)(n, in, out, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    count_plan(plan != NULL);
+    if (plan == NULL) {
+        plan = FFTW(plan_dft_r2c_1d)(n, in, out, FFTW_MEASURE);
+    }
+    return plan;
+}
+
+// creates a complex to real fft plan, from wisdom if possible, by measuring otherwise
+FFTW(plan) cache_plan_c2r(int n, FFTW(complex) *in, real_t *out)
+{
+    wisdom_load();
+    FFTW(plan) plan = FFTW(plan_dft_c2r_1d)(n, in, out, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    count_plan(plan != NULL);
+    if (plan == NULL) {
+        plan = FFTW(plan_dft_c2r_1d)(n, in, out, FFTW_MEASURE);
+    }
+    return plan;
+}
+
+// saves the wisdom, if any plans had to be measured
+void cache_wisdom_save(void)
+{
+    if (cache_stats.plans_measured > 0) {
+        char path[256];
+        cache_path(path, sizeof(path), "wisdom");
+        cache_stats.wisdom_saved = FFTW(export_wisdom_to_filename)(path);
+    }
+}
+
+// reports the time taken to initialise and to get the first frame out, and where the startup state came from
+void cache_report_startup(int64_t init_ns, int64_t first_frame_ns, const char *tables)
+{
+    fprintf(stderr, "startup: init=%.1fms, first frame=%.1fms, plans from wisdom=%d, measured=%d%s, tables=%s\n",
+            init_ns / 1e6, first_frame_ns / 1e6, cache_stats.plans_wisdom, cache_stats.plans_measured,
+            cache_stats.wisdom_saved ? " (saved)" : "", tables);
+}
+
+// returns a key (FNV-1a hash) for the parameters a blob was built for
+uint32_t cache_key(const int *params, int n)
+{
+    uint32_t hash = 2166136261u;
+    const uint8_t *p = (const uint8_t *)params;
+    size_t i;
+    for (i = 0; i < n * sizeof(int); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// maps the cached blob 'name', returns its data or NULL if it is missing or does not match key and size
+const void *cache_map(const char *name, uint32_t key, size_t size)
+{
+    char path[256];
+    cache_path(path, sizeof(path), name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    size_t total = sizeof(struct blob_t) + size;
+    if ((fstat(fd, &st) < 0) || ((size_t)st.st_size != total)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(0, total, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const struct blob_t *blob = (const struct blob_t *)map;
+    if ((memcmp(blob->magic, CACHE_MAGIC, 4) != 0) || (blob->key != key) || (blob->size != size) ||
+        (blob->real_size != sizeof(real_t))) {
+        munmap(map, total);
+        return NULL;
+    }
+    return blob + 1;
+}
+
+// stores a blob in the cache, replacing any previous version atomically
+bool cache_store(const char *name, uint32_t key, const void *data, size_t size)
+{
+    char path[256];
+    char tmp[272];
+    cache_path(path, sizeof(path), name);
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct blob_t blob;
+    memcpy(blob.magic, CACHE_MAGIC, 4);
+    blob.key = key;
+    blob.size = size;
+    blob.real_size = sizeof(real_t);
+    bool ok = (write(fd, &blob, sizeof(blob)) == sizeof(blob)) && (write(fd, data, size) == (ssize_t)size);
+    close(fd);
+    if (!ok || (rename(tmp, path) < 0)) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+/**
+ * Persistent startup state, so relaunched visualisations start quickly.
+ *
+ * FFT plans are created from FFTW wisdom saved in the cache directory, falling back to measuring (and
+ * saving the new wisdom) when the wisdom is missing or stale. Precomputed tables are stored as blobs that
+ * are memory-mapped on the next start, if their key still matches the parameters they were built for.
+ *
+ * The cache directory is $BANNERVIS_CACHE, or /var/tmp/bannervis if that is not set.
+ **/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "real.h"
+
+struct cache_stats_t {
+    int plans_wisdom;   // plans created from wisdom
+    int plans_measured; // plans that had to be measured
+    bool wisdom_saved;
+};
+
+extern struct cache_stats_t cache_stats;
+
+FFTW(plan) cache_plan_r2c(int n, real_t *in, FFTW(complex) *out);
+FFTW(plan) cache_plan_c2r(int n, FFTW(complex) *in, real_t *out);
+void cache_wisdom_save(void);
+void cache_report_startup(int64_t init_ns, int64_t first_frame_ns, const char *tables);
+
+uint32_t cache_key(const int *params, int n);
+const void *cache_map(const char *name, uint32_t key, size_t size);
+bool cache_store(const char *name, uint32_t key, const void *data, size_t size);
+
+#endif
+
@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# Compares the frames rendered by the double and single precision builds of an fft visualisation,
+# both reading the same squeezelite shm file at the same time.
+# The spectrogram renders on a timer, so its two runs are not frame-aligned and differ in timing too.
+# Usage: compare-f32.sh [spectrum|spectrogram] [shm file] [seconds]
+
+prog=${1:-spectrum}
+shm=${2:-/dev/shm/squeezelite-b8:27:eb:f5:ed:87}
+secs=${3:-30}
+
+./$prog $shm $secs > /tmp/$prog-f64.raw 2>/dev/null &
+./$prog-f32 $shm $secs > /tmp/$prog-f32.raw 2>/dev/null &
+wait
+./framediff /tmp/$prog-f64.raw /tmp/$prog-f32.raw
@@ -0,0 +1,376 @@
+#include <stdint.h>
+
+#include "squeeze_vis.h"
+#include "dsp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DSP_IMPL "avx2"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_IMPL "sse2"
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_IMPL "neon"
+#else
+#define DSP_IMPL "scalar"
+#endif
+
+// returns the name of the kernel implementation in use
+const char *dsp_impl(void)
+{
+    return DSP_IMPL;
+}
+
+void dsp_downmix_window_scalar(const s16_t *src, const double *win, double *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = win[i] * (src[2 * i] + src[2 * i + 1]);
+    }
+}
+
+void dsp_downmix_windowf_scalar(const s16_t *src, const float *win, float *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = win[i] * (src[2 * i] + src[2 * i + 1]);
+    }
+}
+
+void dsp_downmix_scalar(const s16_t *src, double *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = src[2 * i] + src[2 * i + 1];
+    }
+}
+
+void dsp_downmixf_scalar(const s16_t *src, float *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = src[2 * i] + src[2 * i + 1];
+    }
+}
+
+void dsp_window_scalar(const double *x, const double *win, double *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = win[i] * x[i];
+    }
+}
+
+void dsp_windowf_scalar(const float *x, const float *win, float *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        dst[i] = win[i] * x[i];
+    }
+}
+
+double dsp_sum_squares_scalar(const double *x, int n)
+{
+    double sum = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+float dsp_sum_squaresf_scalar(const float *x, int n)
+{
+    float sum = 0.0f;
+    int i;
+    for (i = 0; i < n; i++) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+void dsp_sum_squares_stereo_scalar(const s16_t *src, int n, int64_t *sum_l, int64_t *sum_r)
+{
+    int64_t l = 0;
+    int64_t r = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+        l += src[2 * i] * src[2 * i];
+        r += src[2 * i + 1] * src[2 * i + 1];
+    }
+    *sum_l = l;
+    *sum_r = r;
+}
+
+void dsp_downmix_window(const s16_t *src, const double *win, double *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (; i + 8 <= n; i += 8) {
+        // l + r of 8 stereo samples as 32-bit integers
+        __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)&src[2 * i]), ones);
+        __m256d lo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(m));
+        __m256d hi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(m, 1));
+        _mm256_storeu_pd(&dst[i], _mm256_mul_pd(lo, _mm256_loadu_pd(&win[i])));
+        _mm256_storeu_pd(&dst[i + 4], _mm256_mul_pd(hi, _mm256_loadu_pd(&win[i + 4])));
+    }
+#elif defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 4 <= n; i += 4) {
+        // l + r of 4 stereo samples as 32-bit integers
+        __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&src[2 * i]), ones);
+        __m128d lo = _mm_cvtepi32_pd(m);
+        __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_pd(&dst[i], _mm_mul_pd(lo, _mm_loadu_pd(&win[i])));
+        _mm_storeu_pd(&dst[i + 2], _mm_mul_pd(hi, _mm_loadu_pd(&win[i + 2])));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= n; i += 4) {
+        // deinterleave 4 stereo samples and add left and right as 32-bit integers
+        int16x4x2_t lr = vld2_s16(&src[2 * i]);
+        int32x4_t m = vaddl_s16(lr.val[0], lr.val[1]);
+        float64x2_t lo = vcvtq_f64_s64(vmovl_s32(vget_low_s32(m)));
+        float64x2_t hi = vcvtq_f64_s64(vmovl_s32(vget_high_s32(m)));
+        vst1q_f64(&dst[i], vmulq_f64(lo, vld1q_f64(&win[i])));
+        vst1q_f64(&dst[i + 2], vmulq_f64(hi, vld1q_f64(&win[i + 2])));
+    }
+#endif
+    dsp_downmix_window_scalar(src + 2 * i, win + i, dst + i, n - i);
+}
+
+void dsp_downmix(const s16_t *src, double *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)&src[2 * i]), ones);
+        _mm256_storeu_pd(&dst[i], _mm256_cvtepi32_pd(_mm256_castsi256_si128(m)));
+        _mm256_storeu_pd(&dst[i + 4], _mm256_cvtepi32_pd(_mm256_extracti128_si256(m, 1)));
+    }
+#elif defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 4 <= n; i += 4) {
+        __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&src[2 * i]), ones);
+        _mm_storeu_pd(&dst[i], _mm_cvtepi32_pd(m));
+        _mm_storeu_pd(&dst[i + 2], _mm_cvtepi32_pd(_mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= n; i += 4) {
+        int16x4x2_t lr = vld2_s16(&src[2 * i]);
+        int32x4_t m = vaddl_s16(lr.val[0], lr.val[1]);
+        vst1q_f64(&dst[i], vcvtq_f64_s64(vmovl_s32(vget_low_s32(m))));
+        vst1q_f64(&dst[i + 2], vcvtq_f64_s64(vmovl_s32(vget_high_s32(m))));
+    }
+#endif
+    dsp_downmix_scalar(src + 2 * i, dst + i, n - i);
+}
+
+void dsp_window(const double *x, const double *win, double *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(&dst[i], _mm256_mul_pd(_mm256_loadu_pd(&x[i]), _mm256_loadu_pd(&win[i])));
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(&dst[i], _mm_mul_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&win[i])));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 2 <= n; i += 2) {
+        vst1q_f64(&dst[i], vmulq_f64(vld1q_f64(&x[i]), vld1q_f64(&win[i])));
+    }
+#endif
+    dsp_window_scalar(x + i, win + i, dst + i, n - i);
+}
+
+double dsp_sum_squares(const double *x, int n)
+{
+    int i = 0;
+    double sum = 0.0;
+#if defined(__AVX2__)
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    for (; i + 8 <= n; i += 8) {
+        __m256d a = _mm256_loadu_pd(&x[i]);
+        __m256d b = _mm256_loadu_pd(&x[i + 4]);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(a, a));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(b, b));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m128d a = _mm_loadu_pd(&x[i]);
+        __m128d b = _mm_loadu_pd(&x[i + 2]);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(a, a));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(b, b));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    float64x2_t acc0 = vdupq_n_f64(0.0);
+    float64x2_t acc1 = vdupq_n_f64(0.0);
+    for (; i + 4 <= n; i += 4) {
+        float64x2_t a = vld1q_f64(&x[i]);
+        float64x2_t b = vld1q_f64(&x[i + 2]);
+        acc0 = vfmaq_f64(acc0, a, a);
+        acc1 = vfmaq_f64(acc1, b, b);
+    }
+    sum = vaddvq_f64(vaddq_f64(acc0, acc1));
+#endif
+    return sum + dsp_sum_squares_scalar(x + i, n - i);
+}
+
+void dsp_downmix_windowf(const s16_t *src, const float *win, float *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)&src[2 * i]), ones);
+        _mm256_storeu_ps(&dst[i], _mm256_mul_ps(_mm256_cvtepi32_ps(m), _mm256_loadu_ps(&win[i])));
+    }
+#elif defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 4 <= n; i += 4) {
+        __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&src[2 * i]), ones);
+        _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(m), _mm_loadu_ps(&win[i])));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        int16x4x2_t lr = vld2_s16(&src[2 * i]);
+        float32x4_t m = vcvtq_f32_s32(vaddl_s16(lr.val[0], lr.val[1]));
+        vst1q_f32(&dst[i], vmulq_f32(m, vld1q_f32(&win[i])));
+    }
+#endif
+    dsp_downmix_windowf_scalar(src + 2 * i, win + i, dst + i, n - i);
+}
+
+void dsp_downmixf(const s16_t *src, float *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)&src[2 * i]), ones);
+        _mm256_storeu_ps(&dst[i], _mm256_cvtepi32_ps(m));
+    }
+#elif defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 4 <= n; i += 4) {
+        __m128i m = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&src[2 * i]), ones);
+        _mm_storeu_ps(&dst[i], _mm_cvtepi32_ps(m));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        int16x4x2_t lr = vld2_s16(&src[2 * i]);
+        vst1q_f32(&dst[i], vcvtq_f32_s32(vaddl_s16(lr.val[0], lr.val[1])));
+    }
+#endif
+    dsp_downmixf_scalar(src + 2 * i, dst + i, n - i);
+}
+
+void dsp_windowf(const float *x, const float *win, float *dst, int n)
+{
+    int i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&dst[i], _mm256_mul_ps(_mm256_loadu_ps(&x[i]), _mm256_loadu_ps(&win[i])));
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_loadu_ps(&x[i]), _mm_loadu_ps(&win[i])));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(&dst[i], vmulq_f32(vld1q_f32(&x[i]), vld1q_f32(&win[i])));
+    }
+#endif
+    dsp_windowf_scalar(x + i, win + i, dst + i, n - i);
+}
+
+float dsp_sum_squaresf(const float *x, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(&x[i]);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(a, a));
+    }
+    __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc4);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(&x[i]);
+        acc = _mm_add_ps(acc, _mm_mul_ps(a, a));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t a = vld1q_f32(&x[i]);
+        acc = vmlaq_f32(acc, a, a);
+    }
+    float32x2_t acc2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(acc2, acc2), 0);
+#endif
+    return sum + dsp_sum_squaresf_scalar(x + i, n - i);
+}
+
+void dsp_sum_squares_stereo(const s16_t *src, int n, int64_t *sum_l, int64_t *sum_r)
+{
+    int i = 0;
+    int64_t l = 0;
+    int64_t r = 0;
+#if defined(__SSE2__)
+    // squares fit in 31 bits, they are accumulated in 64-bit lanes: left in lane 0, right in lane 1
+    const __m128i mask_l = _mm_set1_epi32(0x0000FFFF);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[2 * i]);
+        __m128i vl = _mm_and_si128(v, mask_l);
+        __m128i vr = _mm_srli_epi32(v, 16);
+        __m128i sl = _mm_madd_epi16(vl, vl);
+        __m128i sr = _mm_madd_epi16(vr, vr);
+        // pairwise sums of 2 squares still fit in 32 bits unsigned
+        __m128i pl = _mm_add_epi64(_mm_unpacklo_epi32(sl, zero), _mm_unpackhi_epi32(sl, zero));
+        __m128i pr = _mm_add_epi64(_mm_unpacklo_epi32(sr, zero), _mm_unpackhi_epi32(sr, zero));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi64(pl, pr));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi64(pl, pr));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    l = lanes[0];
+    r = lanes[1];
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    int64x2_t acc_l = vdupq_n_s64(0);
+    int64x2_t acc_r = vdupq_n_s64(0);
+    for (; i + 4 <= n; i += 4) {
+        int16x4x2_t lr = vld2_s16(&src[2 * i]);
+        acc_l = vpadalq_s32(acc_l, vmull_s16(lr.val[0], lr.val[0]));
+        acc_r = vpadalq_s32(acc_r, vmull_s16(lr.val[1], lr.val[1]));
+    }
+    l = vaddvq_s64(acc_l);
+    r = vaddvq_s64(acc_r);
+#endif
+    int64_t tail_l, tail_r;
+    dsp_sum_squares_stereo_scalar(src + 2 * i, n - i, &tail_l, &tail_r);
+    *sum_l = l + tail_l;
+    *sum_r = r + tail_r;
+}
@@ -0,0 +1,46 @@
+/**
+ * Vectorised kernels for the hot loops shared by the visualisations.
+ *
+ * The implementation is chosen at build time from the instruction sets the compiler targets:
+ * AVX2 or SSE2 on x86, NEON on ARM (64-bit ARM only for double precision), and a portable scalar version
+ * otherwise.
+ * The scalar versions are always available, to check the vectorised ones against.
+ * Kernels on floating point data have a double version and a single precision version with an f suffix.
+ **/
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+#include "squeeze_vis.h"
+
+const char *dsp_impl(void);
+
+// dst[i] = win[i] * (src[2i] + src[2i+1]), converts n interleaved stereo samples to windowed mono
+void dsp_downmix_window(const s16_t *src, const double *win, double *dst, int n);
+void dsp_downmix_windowf(const s16_t *src, const float *win, float *dst, int n);
+// dst[i] = src[2i] + src[2i+1], converts n interleaved stereo samples to mono
+void dsp_downmix(const s16_t *src, double *dst, int n);
+void dsp_downmixf(const s16_t *src, float *dst, int n);
+// dst[i] = win[i] * x[i]
+void dsp_window(const double *x, const double *win, double *dst, int n);
+void dsp_windowf(const float *x, const float *win, float *dst, int n);
+// returns the sum of x[i]^2 over n values, e.g. n = 2 * bins for the power in a range of fft bins
+double dsp_sum_squares(const double *x, int n);
+float dsp_sum_squaresf(const float *x, int n);
+// calculates the sum of squares of the left and right channel over n interleaved stereo samples
+void dsp_sum_squares_stereo(const s16_t *src, int n, int64_t *sum_l, int64_t *sum_r);
+
+void dsp_downmix_window_scalar(const s16_t *src, const double *win, double *dst, int n);
+void dsp_downmix_windowf_scalar(const s16_t *src, const float *win, float *dst, int n);
+void dsp_downmix_scalar(const s16_t *src, double *dst, int n);
+void dsp_downmixf_scalar(const s16_t *src, float *dst, int n);
+void dsp_window_scalar(const double *x, const double *win, double *dst, int n);
+void dsp_windowf_scalar(const float *x, const float *win, float *dst, int n);
+double dsp_sum_squares_scalar(const double *x, int n);
+float dsp_sum_squaresf_scalar(const float *x, int n);
+void dsp_sum_squares_stereo_scalar(const s16_t *src, int n, int64_t *sum_l, int64_t *sum_r);
+
+#endif
+
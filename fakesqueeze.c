@@ -0,0 +1,404 @@
+/**
+ * Stand-in for squeezelite built with OPT_VIS, to run and measure the visualisations without it.
+ *
+ * It creates the shared memory file with the struct vis_t layout from squeeze_vis.h and writes audio into it
+ * in chunks at the pace of the sample rate, advancing buf_index and updated the way squeezelite does.
+ * Signals: a sine, a logarithmic sweep, noise, silence, pulses (tone bursts with long silences in between,
+ * for latency measurements) or a looped WAV file.
+ *
+ * With -x it also runs a visualisation against it as a benchmark: the command gets the shm file name appended,
+ * its stdout must be raw rgb888 frames, of 80x8 pixels or the geometry given with -g. At the end it reports the
+ * frame rate, the cpu use of the visualisation, and with pulses the latency from the audio being published to the
+ * first frame that shows it, which is the first frame that is clearly brighter than the last frame before the
+ * pulse.
+ **/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // fprintf, perror
+#include <stdlib.h>     // exit, atoi, atof
+#include <string.h>     // memcpy, strcmp
+#include <math.h>       // sin, pow
+#include <unistd.h>     // ftruncate, fork, read
+#include <fcntl.h>      // open
+#include <signal.h>     // kill
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>   // mmap
+#include <sys/wait.h>   // waitpid
+#include <sys/resource.h>   // getrusage
+
+#include "squeeze_vis.h"
+#include "mono.h"
+#include "output.h"
+#include "wav.h"
+
+// led banner definitions, for the frames read in benchmark mode
+#define WIDTH 80
+#define HEIGHT 8
+
+// pulses: a tone of PULSE_ON ns every PULSE_PERIOD ns, the silence is long enough for a scrolling display
+// to go dark again
+#define PULSE_ON        500000000LL
+#define PULSE_PERIOD    3000000000LL
+// a frame showing a pulse is brighter than the last frame before it by at least this much (sum of bytes)
+#define PULSE_BRIGHTER  512
+#define MAX_PULSES      1024
+
+#define SIGNAL_SINE     0
+#define SIGNAL_SWEEP    1
+#define SIGNAL_NOISE    2
+#define SIGNAL_SILENCE  3
+#define SIGNAL_PULSE    4
+#define SIGNAL_WAV      5
+
+static const char *signal_names[] = { "sine", "sweep", "noise", "silence", "pulse", "wav" };
+
+static struct vis_t *vis;
+
+// producer settings
+static int signal_type = SIGNAL_SWEEP;
+static int rate = 44100;
+static int chunk = 0;
+static double freq = 1000.0;
+static double amplitude = 0.5;
+static struct wav_t wav;
+static int64_t duration = 0;
+
+// size of the frames read in benchmark mode
+static int frame_size = WIDTH * HEIGHT * 3;
+
+// publish times of the pulses, written by the producer thread
+static int64_t pulse_ns[MAX_PULSES];
+static int pulses;
+
+// creates the shared memory file and maps it
+static bool create(const char *filename)
+{
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open failed");
+        return false;
+    }
+    if (ftruncate(fd, sizeof(struct vis_t)) < 0) {
+        perror("ftruncate failed");
+        close(fd);
+        return false;
+    }
+    vis = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (vis == MAP_FAILED) {
+        perror("mmap failed");
+        return false;
+    }
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_rwlock_init(&vis->rwlock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+
+    vis->buf_size = VIS_BUF_SIZE;
+    vis->buf_index = 0;
+    vis->rate = rate;
+    vis->updated = time(NULL);
+    memset(vis->buffer, 0, sizeof(vis->buffer));
+    vis->running = true;
+    return true;
+}
+
+// generates frames stereo samples of the signal, starting at sample position pos, returns whether a pulse
+// starts in them
+static bool generate(s16_t *dst, int frames, int64_t pos)
+{
+    static double phase = 0.0;
+    static uint32_t noise = 1;
+    bool pulse = false;
+    int i;
+    for (i = 0; i < frames; i++, pos++) {
+        double t = (double)pos / rate;
+        double v = 0.0;
+        switch (signal_type) {
+        case SIGNAL_SINE:
+            phase += 2 * M_PI * freq / rate;
+            v = sin(phase);
+            break;
+        case SIGNAL_SWEEP:
+            // 20 Hz to 20 kHz in 10 seconds, then again
+            phase += 2 * M_PI * 20.0 * pow(1000.0, fmod(t, 10.0) / 10.0) / rate;
+            v = sin(phase);
+            break;
+        case SIGNAL_NOISE:
+            noise = noise * 1664525 + 1013904223;
+            v = (int32_t)noise / 2147483648.0;
+            break;
+        case SIGNAL_PULSE: {
+            int64_t ns = pos * 1000000000LL / rate;
+            if ((ns % PULSE_PERIOD) < PULSE_ON) {
+                if (((pos - 1) * 1000000000LL / rate) % PULSE_PERIOD >= PULSE_ON) {
+                    pulse = true;
+                }
+                phase += 2 * M_PI * freq / rate;
+                v = sin(phase);
+            }
+            break;
+        }
+        case SIGNAL_WAV:
+            dst[2 * i] = wav.samples[2 * (pos % wav.frames)];
+            dst[2 * i + 1] = wav.samples[2 * (pos % wav.frames) + 1];
+            continue;
+        default:
+            break;
+        }
+        dst[2 * i] = dst[2 * i + 1] = (s16_t)(32767.0 * amplitude * v);
+    }
+    return pulse;
+}
+
+// writes audio into the visualisation buffer at the pace of the sample rate until the duration has passed
+static void *produce(void *arg)
+{
+    (void) arg;
+    static s16_t samples[2 * 48000];
+    int64_t start = mono_ns();
+    int64_t next = start;
+    int64_t pos = 0;
+    while ((duration == 0) || (next - start < duration)) {
+        bool pulse = generate(samples, chunk, pos);
+        pos += chunk;
+
+        pthread_rwlock_wrlock(&vis->rwlock);
+        int index = vis->buf_index;
+        int len = 2 * chunk;
+        int first = (len < VIS_BUF_SIZE - index) ? len : VIS_BUF_SIZE - index;
+        memcpy(&vis->buffer[index], samples, sizeof(s16_t) * first);
+        memcpy(&vis->buffer[0], samples + first, sizeof(s16_t) * (len - first));
+        vis->rate = rate;
+        vis->updated = time(NULL);
+        __atomic_store_n(&vis->buf_index, (index + len) % VIS_BUF_SIZE, __ATOMIC_RELEASE);
+        pthread_rwlock_unlock(&vis->rwlock);
+
+        if (pulse && (pulses < MAX_PULSES)) {
+            pulse_ns[pulses] = mono_ns();
+            __atomic_store_n(&pulses, pulses + 1, __ATOMIC_RELEASE);
+        }
+
+        next += chunk * 1000000000LL / rate;
+        mono_sleep_until(next);
+    }
+    vis->running = false;
+    return NULL;
+}
+
+// returns the sum of all bytes in a frame, a measure of its brightness
+static long brightness(const uint8_t *frame)
+{
+    long sum = 0;
+    int i;
+    for (i = 0; i < frame_size; i++) {
+        sum += frame[i];
+    }
+    return sum;
+}
+
+// runs the command against the producer, reads its frames and reports on it
+static void benchmark(const char *command, const char *filename)
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe failed");
+        exit(-1);
+    }
+    int64_t start = mono_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        close(fds[0]);
+        close(fds[1]);
+        char line[1024];
+        snprintf(line, sizeof(line), "exec %s %s", command, filename);
+        execl("/bin/sh", "sh", "-c", line, (char *)NULL);
+        perror("exec failed");
+        exit(-1);
+    }
+    close(fds[1]);
+
+    static uint8_t frame[OUTPUT_MAX_SIZE];
+    int fill = 0;
+    long frames = 0;
+    long ref = -1;          // brightness of the last frame before the pulse being looked for
+    int pulse = 0;          // pulse being looked for
+    int found = 0;
+    int missed = 0;
+    double latency_sum = 0.0;
+    double latency_max = 0.0;
+    bool done = false;
+    while (!done) {
+        // stop the visualisation if it does not stop by itself after the producer
+        struct pollfd pfd = { fds[0], POLLIN, 0 };
+        if (poll(&pfd, 1, 100) == 0) {
+            if (mono_ns() - start > duration + 2000000000LL) {
+                kill(pid, SIGTERM);
+            }
+            continue;
+        }
+        ssize_t n = read(fds[0], frame + fill, frame_size - fill);
+        if (n <= 0) {
+            break;
+        }
+        fill += n;
+        if (fill < frame_size) {
+            continue;
+        }
+        fill = 0;
+        frames++;
+
+        // latency of the pulses
+        int64_t now = mono_ns();
+        long b = brightness(frame);
+        int published = __atomic_load_n(&pulses, __ATOMIC_ACQUIRE);
+        if ((pulse < published) && (now >= pulse_ns[pulse])) {
+            double latency = (now - pulse_ns[pulse]) / 1e6;
+            if ((ref >= 0) && (b >= ref + PULSE_BRIGHTER)) {
+                latency_sum += latency;
+                latency_max = (latency > latency_max) ? latency : latency_max;
+                found++;
+                pulse++;
+                ref = -1;
+            } else if (latency > PULSE_ON / 1e6) {
+                missed++;
+                pulse++;
+                ref = -1;
+            }
+        } else {
+            ref = b;
+        }
+    }
+    close(fds[0]);
+    double seconds = (mono_ns() - start) / 1e9;
+
+    int status;
+    waitpid(pid, &status, 0);
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+                 usage.ru_stime.tv_usec / 1e6;
+
+    printf("frames=%ld, fps=%.1f, cpu=%.1f%%", frames, frames / seconds, 100.0 * cpu / seconds);
+    if (signal_type == SIGNAL_PULSE) {
+        printf(", latency=%.1f/%.1fms (avg/max of %d pulses, %d missed)",
+               (found > 0) ? latency_sum / found : 0.0, latency_max, found, missed);
+    }
+    printf("\n");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [options]\n", name);
+    fprintf(stderr, "  -o <file>    shared memory file (default /dev/shm/squeezelite-fake)\n");
+    fprintf(stderr, "  -s <signal>  sine, sweep, noise, silence, pulse or wav (default sweep)\n");
+    fprintf(stderr, "  -i <file>    WAV file to play, implies -s wav\n");
+    fprintf(stderr, "  -r <rate>    sample rate (default 44100, or the rate of the WAV file)\n");
+    fprintf(stderr, "  -c <frames>  frames written at once (default rate / 100)\n");
+    fprintf(stderr, "  -f <hz>      frequency of the sine and the pulses (default 1000)\n");
+    fprintf(stderr, "  -a <level>   amplitude, 0..1 (default 0.5)\n");
+    fprintf(stderr, "  -t <secs>    seconds to run (default forever, 10 with -x)\n");
+    fprintf(stderr, "  -x <cmd>     run the visualisation cmd against it and report fps, cpu and latency\n");
+    fprintf(stderr, "  -g <WxH>     geometry of the raw rgb888 frames cmd writes (default %dx%d)\n", WIDTH, HEIGHT);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *filename = "/dev/shm/squeezelite-fake";
+    const char *wav_file = NULL;
+    const char *command = NULL;
+    int seconds = -1;
+    int rate_arg = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:s:i:r:c:f:a:t:x:g:h")) != -1) {
+        switch (opt) {
+        case 'o':
+            filename = optarg;
+            break;
+        case 's': {
+            unsigned int i;
+            signal_type = -1;
+            for (i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++) {
+                if (strcmp(optarg, signal_names[i]) == 0) {
+                    signal_type = i;
+                }
+            }
+            if (signal_type < 0) {
+                usage(argv[0]);
+            }
+            break;
+        }
+        case 'i':
+            wav_file = optarg;
+            signal_type = SIGNAL_WAV;
+            break;
+        case 'r':
+            rate_arg = atoi(optarg);
+            break;
+        case 'c':
+            chunk = atoi(optarg);
+            break;
+        case 'f':
+            freq = atof(optarg);
+            break;
+        case 'a':
+            amplitude = atof(optarg);
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'x':
+            command = optarg;
+            break;
+        case 'g': {
+            int width, height;
+            if ((sscanf(optarg, "%dx%d", &width, &height) != 2) || (width <= 0) || (height <= 0) ||
+                (width * height * 3 > OUTPUT_MAX_SIZE)) {
+                usage(argv[0]);
+            }
+            frame_size = width * height * 3;
+            break;
+        }
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (signal_type == SIGNAL_WAV) {
+        if ((wav_file == NULL) || !wav_read(wav_file, &wav) || (wav.frames == 0)) {
+            exit(-1);
+        }
+        rate = wav.rate;
+    }
+    if (rate_arg > 0) {
+        rate = rate_arg;
+    }
+    if (chunk <= 0) {
+        chunk = rate / 100;
+    }
+    if ((rate <= 0) || (chunk > 48000) || (2 * chunk > VIS_BUF_SIZE / 2)) {
+        fprintf(stderr, "invalid rate or chunk size\n");
+        exit(-1);
+    }
+    if (seconds < 0) {
+        seconds = (command != NULL) ? 10 : 0;
+    }
+    duration = seconds * 1000000000LL;
+
+    if (!create(filename)) {
+        exit(-1);
+    }
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, NULL);
+    if (command != NULL) {
+        benchmark(command, filename);
+    }
+    pthread_join(producer, NULL);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>      // perror, fprintf
+#include <string.h>     // memset
+#include <unistd.h>     // ftruncate, close
+#include <sys/mman.h>   // mmap
+#include <fcntl.h>      // open
+
+#include "mono.h"
+#include "fb.h"
+
+// creates (or truncates) the framebuffer file and maps it, returns NULL on failure
+struct fb_t *fb_create(const char *filename, int width, int height, int format, int frame_size)
+{
+    if ((frame_size <= 0) || (frame_size > FB_MAX_FRAME)) {
+        return NULL;
+    }
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open failed");
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct fb_t)) < 0) {
+        perror("ftruncate failed");
+        close(fd);
+        return NULL;
+    }
+    struct fb_t *fb = (struct fb_t *)mmap(0, sizeof(struct fb_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (fb == MAP_FAILED) {
+        perror("mmap failed");
+        return NULL;
+    }
+
+    // readers check the magic last
+    __atomic_store_n(&fb->magic, 0, __ATOMIC_RELAXED);
+    fb->width = width;
+    fb->height = height;
+    fb->format = format;
+    fb->frame_size = frame_size;
+    fb->seq = 0;
+    fb->updated = 0;
+    memset(fb->buffer, 0, sizeof(fb->buffer));
+    fb->running = 1;
+    __atomic_store_n(&fb->magic, FB_MAGIC, __ATOMIC_RELEASE);
+    return fb;
+}
+
+// returns the buffer to draw the next frame into
+uint8_t *fb_back(struct fb_t *fb)
+{
+    // the last seq store has to be visible before any of the new pixels, or a reader could take the buffer
+    // being overwritten for one that is still valid
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return fb->buffer[(fb->seq + 1) % FB_BUFFERS];
+}
+
+// makes the frame in the back buffer the latest frame
+void fb_publish(struct fb_t *fb)
+{
+    fb->updated = mono_ns();
+    __atomic_store_n(&fb->seq, fb->seq + 1, __ATOMIC_RELEASE);
+}
+
+// tells readers that no more frames follow
+void fb_close(struct fb_t *fb)
+{
+    __atomic_store_n(&fb->running, 0, __ATOMIC_RELEASE);
+    munmap(fb, sizeof(struct fb_t));
+}
+
+// maps an existing framebuffer file for reading, returns NULL on failure
+struct fb_t *fb_open(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("open failed");
+        return NULL;
+    }
+    struct fb_t *fb = (struct fb_t *)mmap(0, sizeof(struct fb_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (fb == MAP_FAILED) {
+        perror("mmap failed");
+        return NULL;
+    }
+    if (__atomic_load_n(&fb->magic, __ATOMIC_ACQUIRE) != FB_MAGIC) {
+        fprintf(stderr, "%s is not a framebuffer\n", filename);
+        munmap(fb, sizeof(struct fb_t));
+        return NULL;
+    }
+    return fb;
+}
+
+// returns the latest complete frame and its sequence number
+const uint8_t *fb_latest(const struct fb_t *fb, uint32_t *seq)
+{
+    *seq = __atomic_load_n(&fb->seq, __ATOMIC_ACQUIRE);
+    return fb->buffer[*seq % FB_BUFFERS];
+}
+
+// returns whether the frame with sequence number seq is still intact, call this after using the frame
+bool fb_valid(const struct fb_t *fb, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t now = __atomic_load_n(&fb->seq, __ATOMIC_RELAXED);
+    // the writer starts overwriting it once it publishes seq + FB_BUFFERS - 1
+    return (now - seq) < (FB_BUFFERS - 1);
+}
@@ -0,0 +1,45 @@
+/**
+ * Shared-memory framebuffer, an output sink in the spirit of squeezelite's vis_t.
+ *
+ * The visualisation packs each frame straight into one of FB_BUFFERS buffers in a /dev/shm file and then
+ * publishes it by incrementing seq, the latest complete frame is always buffer[seq % FB_BUFFERS].
+ * The buffer being written is the one after it, so with 3 buffers the latest frame is only overwritten once
+ * seq has advanced by 2. A reader (e.g. the led banner driver) maps the file, takes the latest frame without
+ * any system call, and checks seq again afterwards to know the frame was not overwritten while it was used.
+ **/
+
+#ifndef FB_H
+#define FB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FB_MAGIC        0x31424656  // "VFB1"
+#define FB_BUFFERS      3
+#define FB_MAX_FRAME    65536
+
+struct fb_t {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;        // PIXEL_RGB888, PIXEL_RGB565 or PIXEL_RGB444
+    uint32_t frame_size;    // bytes per frame
+    uint32_t running;       // cleared when the writer stops
+    uint32_t seq;           // number of frames published
+    uint32_t reserved;
+    int64_t updated;        // monotonic time of the latest frame (ns)
+    uint8_t buffer[FB_BUFFERS][FB_MAX_FRAME];
+};
+
+// writer
+struct fb_t *fb_create(const char *filename, int width, int height, int format, int frame_size);
+uint8_t *fb_back(struct fb_t *fb);
+void fb_publish(struct fb_t *fb);
+void fb_close(struct fb_t *fb);
+
+// reader
+struct fb_t *fb_open(const char *filename);
+const uint8_t *fb_latest(const struct fb_t *fb, uint32_t *seq);
+bool fb_valid(const struct fb_t *fb, uint32_t seq);
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * Reader for the shared-memory framebuffer (see fb.h), to check the output of a visualisation run with -o.
+ * Polls the framebuffer, takes every new frame the way a led banner driver would, and reports per second how
+ * many frames it saw, how many were published in between without being seen, and how many were overwritten
+ * while being read. With -w the frames are also written to stdout, e.g. for framediff.
+ **/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // fprintf, fwrite
+#include <stdlib.h>     // exit, atoi
+#include <string.h>     // memcpy, strcmp
+
+#include "mono.h"
+#include "fb.h"
+
+static uint8_t frame[FB_MAX_FRAME];
+
+// argv[1] = framebuffer file
+// argv[2] = polling interval in us (if not present: 1000)
+// argv[3] = -w to write the frames to stdout
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <framebuffer> [interval us] [-w]\n", argv[0]);
+        exit(-1);
+    }
+    struct fb_t *fb = fb_open(argv[1]);
+    if (fb == NULL) {
+        exit(-1);
+    }
+    int64_t interval = 1000000;
+    if (argc > 2) {
+        interval = atoi(argv[2]) * 1000LL;
+    }
+    bool write_frames = (argc > 3) && (strcmp(argv[3], "-w") == 0);
+
+    fprintf(stderr, "%dx%d, format %d, %d bytes per frame\n", fb->width, fb->height, fb->format, fb->frame_size);
+
+    uint32_t last = __atomic_load_n(&fb->seq, __ATOMIC_ACQUIRE);
+    int frames = 0;
+    int missed = 0;
+    int torn = 0;
+    int64_t next = mono_ns();
+    int64_t report = next + 1000000000LL;
+    while (__atomic_load_n(&fb->running, __ATOMIC_ACQUIRE)) {
+        next += interval;
+        mono_sleep_until(next);
+
+        uint32_t seq;
+        const uint8_t *latest = fb_latest(fb, &seq);
+        if (seq != last) {
+            memcpy(frame, latest, fb->frame_size);
+            if (!fb_valid(fb, seq)) {
+                torn++;
+            } else {
+                if (write_frames) {
+                    fwrite(frame, fb->frame_size, 1, stdout);
+                }
+                missed += seq - last - 1;
+                frames++;
+            }
+            last = seq;
+        }
+
+        if (next >= report) {
+            fprintf(stderr, "frames=%d, missed=%d, torn=%d\n", frames, missed, torn);
+            frames = 0;
+            missed = 0;
+            torn = 0;
+            report += 1000000000LL;
+        }
+    }
+    fprintf(stderr, "writer stopped after %u frames\n", last);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * Compares two streams of raw RGB frames, e.g. the output of spectrum and spectrum-f32 for the same audio,
+ * and reports how far they drift apart: per frame the number of differing pixels and the largest colour
+ * difference, and a summary over all frames. Exits with 1 when any frame differs or one stream is longer, so it
+ * can check a render against stored golden frames.
+ **/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // fopen, fread, printf
+#include <stdlib.h>     // exit, atoi, abs
+
+// led banner definitions
+#define WIDTH 80
+#define HEIGHT 8
+
+// argv[1] = first frame file
+// argv[2] = second frame file
+// argv[3] = -v to print a line for every frame that differs
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <frames-a> <frames-b> [-v]\n", argv[0]);
+        exit(-1);
+    }
+    bool verbose = (argc > 3);
+
+    FILE *fa = fopen(argv[1], "rb");
+    FILE *fb = fopen(argv[2], "rb");
+    if (!fa || !fb) {
+        perror("open failed");
+        exit(-1);
+    }
+
+    static uint8_t a[HEIGHT * WIDTH * 3];
+    static uint8_t b[HEIGHT * WIDTH * 3];
+    int frames = 0;
+    int frames_diff = 0;
+    long pixels_diff = 0;
+    long sum_diff = 0;
+    int max_diff = 0;
+    while ((fread(a, sizeof(a), 1, fa) == 1) && (fread(b, sizeof(b), 1, fb) == 1)) {
+        int i, c;
+        int pixels = 0;
+        int frame_max = 0;
+        for (i = 0; i < (HEIGHT * WIDTH); i++) {
+            int d = 0;
+            for (c = 0; c < 3; c++) {
+                int dc = abs(a[3 * i + c] - b[3 * i + c]);
+                d = (dc > d) ? dc : d;
+                sum_diff += dc;
+            }
+            if (d > 0) {
+                pixels++;
+            }
+            frame_max = (d > frame_max) ? d : frame_max;
+        }
+        if (pixels > 0) {
+            frames_diff++;
+            if (verbose) {
+                printf("frame %6d: %4d pixels differ, max difference %3d\n", frames, pixels, frame_max);
+            }
+        }
+        pixels_diff += pixels;
+        max_diff = (frame_max > max_diff) ? frame_max : max_diff;
+        frames++;
+    }
+
+    if (frames == 0) {
+        fprintf(stderr, "no frames to compare\n");
+        exit(-1);
+    }
+    // a stream still has data when the other ran out first
+    bool longer = !feof(fa) || (fread(b, 1, 1, fb) == 1);
+    printf("frames=%d, differing frames=%d (%.2f%%), differing pixels=%.4f%%, mean abs diff=%.4f, max diff=%d%s\n",
+           frames, frames_diff, 100.0 * frames_diff / frames,
+           100.0 * pixels_diff / ((double)frames * HEIGHT * WIDTH),
+           (double)sum_diff / ((double)frames * HEIGHT * WIDTH * 3), max_diff,
+           longer ? ", lengths differ" : "");
+    return ((frames_diff > 0) || longer) ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * Panel geometry, chosen at run time with -g <width>x<height>, the default being the 80x8 banner.
+ *
+ * The draw functions take the width and height as their first two parameters and index the frame as a
+ * variable length array, so one version of the code serves every size. They are always inlined, and
+ * GEOMETRY_CALL calls them with the common sizes as compile-time constants, so those get their own copy with
+ * fixed loop counts and strides, as fast as when the size was a #define; other sizes take the generic copy.
+ **/
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "output.h"
+
+#define GEOMETRY_MIN_WIDTH      16
+#define GEOMETRY_MAX_WIDTH      1024
+#define GEOMETRY_MIN_HEIGHT     4
+#define GEOMETRY_MAX_HEIGHT     64
+// rgb888 frames have to fit in the output
+#define GEOMETRY_MAX_PIXELS     (OUTPUT_MAX_SIZE / 3)
+
+// a draw function, to be called through GEOMETRY_CALL
+#define GEOMETRY_INLINE static inline __attribute__((always_inline))
+
+// calls draw function f(width, height, ...) with the geometry as constants for the common panel sizes
+#define GEOMETRY_CALL(width, height, f, ...)                                    \
+    ((((width) == 80) && ((height) == 8)) ? f(80, 8, __VA_ARGS__) :            \
+     (((width) == 160) && ((height) == 16)) ? f(160, 16, __VA_ARGS__) :        \
+     f((width), (height), __VA_ARGS__))
+
+#endif
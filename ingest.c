@@ -0,0 +1,214 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>       // time
+
+#include "squeeze_vis.h"
+#include "ring.h"
+#include "mono.h"
+#include "ingest.h"
+#include "offline.h"
+
+// limits on the time slept in one go
+#define MIN_SLEEP_NS    200000LL        // 0.2 ms
+#define MAX_SLEEP_NS    100000000LL     // 100 ms, also used while the producer is idle
+// the clock bounds of the newest sample are not narrowed further with extra looks once they are this close
+#define PROBE_WIDTH_NS  500000LL        // 0.5 ms
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+// returns the nominal time per s16 sample for the current producer rate
+static double nominal_ns_per_sample(void)
+{
+    u32_t rate = vis_mmap->rate;
+    if (rate == 0) {
+        rate = 44100;
+    }
+    return 1e9 / (2.0 * rate);
+}
+
+// looks at the producer index, updates the speed and chunk size estimates when it moved, and narrows the time
+// the newest sample was written on the producer's sample clock
+static void observe(struct ingest_t *ing, int64_t now)
+{
+    u32_t index = vis_mmap->buf_index;
+    int delta = ring_distance(ing->last_index, index);
+    double nominal = nominal_ns_per_sample();
+    // the next chunk was not written by now, so the newest sample was written after this
+    int64_t lo = now - (int64_t)(ing->chunk * nominal);
+    if (delta == 0) {
+        // unless the next chunk is overdue, the producer is late or idle then
+        if ((ing->chunk > 0) && (lo > ing->clock_lo) && (lo <= ing->clock_hi)) {
+            ing->clock_lo = lo;
+        }
+        return;
+    }
+
+    double measured = (double)(now - ing->last_change) / delta;
+    if ((measured > nominal / 4) && (measured < nominal * 4)) {
+        // follow the producer speed with a 1-pole filter
+        ing->ns_per_sample += (measured - ing->ns_per_sample) / 8;
+    } else {
+        // producer was idle or changed rate, start again from the nominal speed
+        ing->ns_per_sample = nominal;
+    }
+
+    // follow the chunk size, quickly downwards and slowly upwards
+    if ((ing->chunk == 0) || (delta < ing->chunk)) {
+        ing->chunk = delta;
+    } else {
+        ing->chunk += (delta - ing->chunk + 15) / 16;
+    }
+    lo = now - (int64_t)(ing->chunk * nominal);
+
+    // carry the bounds to the new newest sample at the sample rate, with some room for drift between the
+    // clocks, and intersect them with those of this look
+    int64_t step = (int64_t)(delta * nominal);
+    ing->clock_lo += step - step / 8192;
+    ing->clock_hi += step + step / 8192;
+    if (lo > ing->clock_lo) {
+        ing->clock_lo = lo;
+    }
+    if (now < ing->clock_hi) {
+        ing->clock_hi = now;
+    }
+    if (ing->clock_lo > ing->clock_hi) {
+        // the producer does not write exactly on its sample clock, a write a little off makes the bounds cross,
+        // the clock is then somewhere in between
+        int64_t t = ing->clock_lo;
+        ing->clock_lo = ing->clock_hi;
+        ing->clock_hi = t;
+    }
+    if (ing->clock_hi - ing->clock_lo > now - lo) {
+        // far apart, the producer was idle or changed rate, start again from this look
+        ing->clock_lo = lo;
+        ing->clock_hi = now;
+    }
+
+    ing->last_index = index;
+    ing->last_change = now;
+}
+
+// returns the estimated time the sample just before last_index was written, on the producer's sample clock
+static int64_t clock_newest(const struct ingest_t *ing)
+{
+    return ing->clock_lo + (ing->clock_hi - ing->clock_lo) / 2;
+}
+
+// initialises the ingest state, poll_ns is the fixed polling interval used for comparison in the stats
+void ingest_init(struct ingest_t *ing, int64_t poll_ns)
+{
+    ing->last_index = vis_mmap->buf_index;
+    ing->last_change = mono_ns();
+    ing->ns_per_sample = nominal_ns_per_sample();
+    ing->chunk = 0;
+    ing->poll_ns = poll_ns;
+    // written at some point before now
+    ing->clock_lo = ing->last_change - MAX_SLEEP_NS;
+    ing->clock_hi = ing->last_change;
+
+    ing->stat_start = ing->last_change;
+    ing->wakeups = 0;
+    ing->early = 0;
+}
+
+// sleeps until at least 'need' samples are available after read_index, returns the number of samples available
+int ingest_wait(struct ingest_t *ing, u32_t read_index, int need)
+{
+    if (offline) {
+        return offline_produce(read_index, need);
+    }
+
+    int misses = 0;
+    bool slept = false;
+    for (;;) {
+        int64_t now = mono_ns();
+        observe(ing, now);
+        int avail = ring_distance(read_index, ing->last_index);
+        if ((avail >= need) || !vis_mmap->running) {
+            return avail;
+        }
+
+        // predict when the missing samples have been written, in whole producer chunks
+        int64_t deadline;
+        if ((time(NULL) - vis_mmap->updated) > 1) {
+            // producer is idle, check back later
+            deadline = now + MAX_SLEEP_NS;
+        } else {
+            if (slept) {
+                // woke up before the data
+                ing->early++;
+            }
+            int missing = need - avail;
+            if (ing->chunk > 0) {
+                missing = (missing + ing->chunk - 1) / ing->chunk * ing->chunk;
+            }
+            deadline = clock_newest(ing) + (int64_t)(missing * ing->ns_per_sample);
+            if (deadline <= now) {
+                // prediction was too optimistic, back off exponentially
+                deadline = now + (MIN_SLEEP_NS << MIN(misses, 6));
+                misses++;
+            }
+            deadline = MIN(deadline, now + MAX_SLEEP_NS);
+        }
+
+        mono_sleep_until(deadline);
+        ing->wakeups++;
+        slept = true;
+    }
+}
+
+// looks at the producer index now, for when the wait is done elsewhere (at a fixed frame rate)
+void ingest_observe(struct ingest_t *ing)
+{
+    if (!offline) {
+        observe(ing, mono_ns());
+    }
+}
+
+// returns a time before until at which a look at the producer index narrows the clock bounds, the middle of
+// the interval in which the next chunk is due, or 0 if there is no need to look before then
+int64_t ingest_probe(const struct ingest_t *ing, int64_t until)
+{
+    if (offline || (ing->chunk == 0) || (ing->clock_hi - ing->clock_lo < PROBE_WIDTH_NS)) {
+        return 0;
+    }
+    int64_t now = mono_ns();
+    int64_t period = (int64_t)(ing->chunk * nominal_ns_per_sample());
+    int64_t probe = clock_newest(ing) + period;
+    if (probe <= now) {
+        // overdue, the producer is late or idle
+        return 0;
+    }
+    return (probe < until) ? probe : 0;
+}
+
+// returns the estimated monotonic time at which the producer wrote the sample just before offset index, on its
+// sample clock, or 0 if that is not known (offline)
+int64_t ingest_written(const struct ingest_t *ing, u32_t index)
+{
+    if (offline) {
+        return 0;
+    }
+    int behind = ring_distance(index, ing->last_index);
+    if (behind > VIS_BUF_SIZE / 2) {
+        // newer than the last observation
+        behind = 0;
+    }
+    return clock_newest(ing) - (int64_t)(behind * nominal_ns_per_sample());
+}
+
+// returns the number of wakeups since the previous call, how many of those came before the data, and how many
+// fewer wakeups that is than fixed polling
+void ingest_stats(struct ingest_t *ing, int *wakeups, int *early, int *saved)
+{
+    int64_t now = mono_ns();
+    int polls = (now - ing->stat_start) / ing->poll_ns;
+
+    *wakeups = ing->wakeups;
+    *early = ing->early;
+    *saved = polls - ing->wakeups;
+
+    ing->stat_start = now;
+    ing->wakeups = 0;
+    ing->early = 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * Event-driven ingest of audio from the squeezelite shared memory buffer.
+ *
+ * Instead of polling buf_index at a fixed interval, this predicts when the producer will have written
+ * the requested number of samples and sleeps until that absolute moment on the monotonic clock.
+ * The prediction uses the producer sample rate, the observed progress of buf_index and the size of the
+ * chunks the producer writes in, so it adapts when the producer speeds up or slows down.
+ *
+ * The same model dates the audio, which is what the audio-to-light latency of a frame is measured from. The time
+ * the reader notices buf_index move can be well after the producer moved it, by the same amount every time
+ * when the reader wakes at a fixed phase to the producer, so the audio is dated on the producer's sample clock
+ * instead: every look at buf_index bounds the time the newest sample was written, it is there already but the
+ * next chunk is not, and the bounds of successive looks are carried along at the sample rate and intersected.
+ * The waits aim at the middle of those bounds, so a wait that ends too early narrows them from below and one
+ * that ends late from above, and at a fixed frame rate a few extra looks narrow them while they are wide.
+ **/
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdint.h>
+
+#include "squeeze_vis.h"
+
+struct ingest_t {
+    u32_t   last_index;     // producer buf_index at the last observed change
+    int64_t last_change;    // monotonic time of the last observed change (ns)
+    double  ns_per_sample;  // estimated time per s16 sample written by the producer (ns)
+    int     chunk;          // typical number of samples the producer writes at once
+    int64_t poll_ns;        // fixed polling interval this replaces, for the statistics
+
+    // producer sample clock: the sample just before last_index was written after clock_lo and by clock_hi
+    int64_t clock_lo;
+    int64_t clock_hi;
+
+    // statistics
+    int64_t stat_start;
+    int     wakeups;
+    int     early;          // wakeups that did not find the requested data yet
+};
+
+void ingest_init(struct ingest_t *ing, int64_t poll_ns);
+int ingest_wait(struct ingest_t *ing, u32_t read_index, int need);
+void ingest_observe(struct ingest_t *ing);
+int64_t ingest_probe(const struct ingest_t *ing, int64_t until);
+int64_t ingest_written(const struct ingest_t *ing, u32_t index);
+void ingest_stats(struct ingest_t *ing, int *wakeups, int *early, int *saved);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdlib.h>     // malloc
+#include <string.h>     // memset, memcpy
+#include <math.h>       // sqrt
+
+#include "squeeze_vis.h"
+#include "ring.h"
+#include "dsp.h"
+#include "level.h"
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+// rate assumed until the producer publishes one
+#define DEFAULT_RATE    44100
+
+// sets up a level meter integrating over ms milliseconds, the window is allocated once the rate is known
+bool level_init(struct level_t *l, int ms)
+{
+    if ((ms < LEVEL_MIN_MS) || (ms > LEVEL_MAX_MS)) {
+        return false;
+    }
+    l->ms = ms;
+    l->rate = 0;
+    l->len = 0;
+    l->history = NULL;
+    l->synced = false;
+    l->samples = 0;
+    l->resyncs = 0;
+    return true;
+}
+
+// appends m stereo samples to the history, updating the sums with the samples that enter and leave the window
+static void append(struct level_t *l, const s16_t *src, int m)
+{
+    while (m > 0) {
+        // the samples leaving the window are the ones overwritten, zeros while it fills up
+        int len = MIN(m, l->len - l->pos);
+        s16_t *dst = l->history + 2 * l->pos;
+        int64_t old_l, old_r, new_l, new_r;
+        dsp_sum_squares_stereo(dst, len, &old_l, &old_r);
+        dsp_sum_squares_stereo(src, len, &new_l, &new_r);
+        l->sum_l += new_l - old_l;
+        l->sum_r += new_r - old_r;
+        memcpy(dst, src, sizeof(s16_t) * 2 * len);
+
+        l->pos = (l->pos + len) % l->len;
+        l->fill = MIN(l->fill + len, l->len);
+        src += 2 * len;
+        m -= len;
+    }
+}
+
+// empties the window and moves the read index back over the newest audio, up to a window of it
+static bool resync(struct level_t *l)
+{
+    u32_t rate = (vis_mmap->rate > 0) ? vis_mmap->rate : DEFAULT_RATE;
+    if ((rate != l->rate) || !l->history) {
+        free(l->history);
+        l->rate = rate;
+        l->len = (int)((int64_t)rate * l->ms / 1000);
+        if (l->len < 1) {
+            l->len = 1;
+        }
+        l->history = (s16_t*) malloc(sizeof(s16_t) * 2 * l->len);
+        if (!l->history) {
+            return false;
+        }
+    }
+    memset(l->history, 0, sizeof(s16_t) * 2 * l->len);
+    l->pos = 0;
+    l->fill = 0;
+    l->sum_l = 0;
+    l->sum_r = 0;
+    l->read_index = ring_fix(vis_mmap->buf_index - MIN(2 * l->len, LEVEL_MAX_LAG));
+    l->synced = true;
+    l->resyncs++;
+    return true;
+}
+
+// takes all new audio from the ring into the window, returns the number of stereo samples taken
+int level_feed(struct level_t *l)
+{
+    int taken = 0;
+    int resyncs = 0;
+    while (resyncs <= 1) {
+        int avail = ring_avail(l->read_index);
+        if (!l->synced || (avail > LEVEL_MAX_LAG) || ((vis_mmap->rate > 0) && (vis_mmap->rate != l->rate))) {
+            // start, or skip ahead, from the newest audio, at most once per call
+            if (!resync(l)) {
+                break;
+            }
+            resyncs++;
+            continue;
+        }
+        int n = MIN(avail, LEVEL_CHUNK) & ~1;
+        if (n == 0) {
+            break;
+        }
+
+        u32_t end = l->read_index + n;
+        if (ring_snapshot(&end, n, n, l->pcm) == 0) {
+            break;
+        }
+        if (ring_fix(end) != ring_fix(l->read_index + n)) {
+            // overwritten while being copied, the window is no longer contiguous
+            l->synced = false;
+            continue;
+        }
+        append(l, l->pcm, n / 2);
+        l->read_index = ring_fix(end);
+        taken += n / 2;
+    }
+    l->samples += taken;
+    return taken;
+}
+
+// returns the rms of the left and right channel over the window (0..32768)
+void level_rms(const struct level_t *l, double *rms_l, double *rms_r)
+{
+    if (l->fill == 0) {
+        *rms_l = 0;
+        *rms_r = 0;
+        return;
+    }
+    *rms_l = sqrt((double)l->sum_l / l->fill);
+    *rms_r = sqrt((double)l->sum_r / l->fill);
+}
+
+void level_free(struct level_t *l)
+{
+    free(l->history);
+    l->history = NULL;
+}
@@ -0,0 +1,51 @@
+/**
+ * Streaming sliding-window RMS level of the left and right channel of the squeezelite visualisation buffer.
+ *
+ * Each call takes only the audio the producer added to the ring since the previous one. It is appended to a
+ * history of the last window of stereo samples, and the sums of squares over the window are kept exactly, in
+ * 64-bit integers, by adding the squares of the new samples and subtracting those of the samples that drop
+ * out. The work per frame follows the amount of new audio, and the level is the RMS of the most recent
+ * integration time of audio, however often it is asked for.
+ * When the reader falls too far behind the producer, or the sample rate changes, the window is started
+ * again from the newest audio.
+ **/
+
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "squeeze_vis.h"
+
+// integration time limits, in ms
+#define LEVEL_MIN_MS    10
+#define LEVEL_MAX_MS    1000
+// samples the reader may lag behind the producer before it skips ahead to the newest audio
+#define LEVEL_MAX_LAG   (VIS_BUF_SIZE / 2)
+// samples copied from the ring at a time
+#define LEVEL_CHUNK     (VIS_BUF_SIZE / 4)
+
+struct level_t {
+    int ms;                 // integration time
+    u32_t rate;             // sample rate the window length was derived from
+    int len;                // window length, in stereo samples
+    s16_t *history;         // the last len stereo samples, as a ring starting at pos
+    int pos;
+    int fill;               // stereo samples in the window, len once it has filled up
+    int64_t sum_l, sum_r;   // sums of squares over the window
+    s16_t pcm[LEVEL_CHUNK];
+    u32_t read_index;       // ring offset of the next sample to take
+    bool synced;
+
+    // statistics
+    int samples;
+    int resyncs;
+};
+
+bool level_init(struct level_t *l, int ms);
+int level_feed(struct level_t *l);
+void level_rms(const struct level_t *l, double *rms_l, double *rms_r);
+void level_free(struct level_t *l);
+
+#endif
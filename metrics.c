@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stdio.h>      // snprintf
+#include <string.h>     // strrchr, strncpy
+#include <unistd.h>     // ftruncate, close, getpid, unlink
+#include <sys/mman.h>   // mmap
+#include <fcntl.h>      // open
+
+#include "squeeze_vis.h"
+#include "ring.h"
+#include "mono.h"
+#include "metrics.h"
+
+#define METRICS_RETRIES 10
+
+static int64_t last_look;
+static char filename[256];
+
+// creates the stats block for a program, named after the file name in argv[0] and the pid, returns NULL on
+// failure
+struct metrics_t *metrics_open(const char *program)
+{
+    const char *name = strrchr(program, '/');
+    name = (name != NULL) ? name + 1 : program;
+    snprintf(filename, sizeof(filename), "/dev/shm/bannervis-stats-%s-%d", name, (int)getpid());
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(struct metrics_t)) < 0) {
+        close(fd);
+        unlink(filename);
+        return NULL;
+    }
+    struct metrics_t *m = (struct metrics_t *)mmap(0, sizeof(struct metrics_t), PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        unlink(filename);
+        return NULL;
+    }
+
+    // readers check the magic first
+    __atomic_store_n(&m->magic, 0, __ATOMIC_RELAXED);
+    memset(m, 0, sizeof(*m));
+    m->pid = getpid();
+    strncpy(m->program, name, sizeof(m->program) - 1);
+    m->running = 1;
+    __atomic_store_n(&m->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+
+    last_look = mono_ns();
+    return m;
+}
+
+// updates the stats block, once per pass of the frame loop; m may be NULL
+void metrics_publish(struct metrics_t *m, long frames, long dropped, int rms)
+{
+    if (m == NULL) {
+        return;
+    }
+    int64_t now = mono_ns();
+    u32_t rate = vis_mmap->rate;
+    time_t updated = vis_mmap->updated;
+
+    // the ring holds VIS_BUF_SIZE / 2 stereo samples
+    bool producing = vis_mmap->running && (time(NULL) - updated <= 1) && (rate > 0);
+    bool overrun = producing && ((now - last_look) * rate / 1000000000LL > VIS_BUF_SIZE / 2);
+    last_look = now;
+
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m->frames = frames;
+    m->dropped = dropped;
+    m->overruns += overrun;
+    m->torn = ring_stats.torn;
+    m->retries = ring_stats.retries;
+    m->rate = rate;
+    m->rms = rms;
+    m->updated = updated;
+    m->published = now;
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELEASE);
+}
+
+// tells readers that the visualisation stopped and removes the stats block
+void metrics_close(struct metrics_t *m)
+{
+    if (m == NULL) {
+        return;
+    }
+    m->running = 0;
+    munmap(m, sizeof(struct metrics_t));
+    unlink(filename);
+}
+
+// maps the stats block of a running visualisation for reading, returns NULL on failure
+const struct metrics_t *metrics_map(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    const struct metrics_t *m = (const struct metrics_t *)mmap(0, sizeof(struct metrics_t), PROT_READ,
+                                                               MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return NULL;
+    }
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC) {
+        munmap((void *)m, sizeof(struct metrics_t));
+        return NULL;
+    }
+    return m;
+}
+
+// copies a consistent version of the stats block, without system calls, returns false if the writer kept
+// changing it
+bool metrics_read(const struct metrics_t *m, struct metrics_t *copy)
+{
+    int attempt;
+    for (attempt = 0; attempt < METRICS_RETRIES; attempt++) {
+        uint32_t before = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, (const void *)m, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t after = __atomic_load_n(&m->seq, __ATOMIC_RELAXED);
+        if (((before & 1) == 0) && (before == after)) {
+            return true;
+        }
+    }
+    return false;
+}
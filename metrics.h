@@ -0,0 +1,50 @@
+/**
+ * Live counters of a visualisation in a small shared-memory block, for watching it from outside (bannerstat).
+ *
+ * Each visualisation creates /dev/shm/bannervis-stats-<program>-<pid>, so instances do not share a block, and
+ * updates it once per pass of its frame loop with plain stores, no system calls and nothing on stderr. The block
+ * is removed when the visualisation stops; bannerstat removes those left behind by a process that was killed.
+ * Offline renders do not create one. The fields are guarded by a sequence
+ * counter in the style of a seqlock: seq is odd while the writer updates them, so a reader copies the block,
+ * checks that seq was even and unchanged around the copy, and otherwise copies again.
+ *
+ * An overrun is counted when the producer ran while the loop did not look at the ring for longer than the
+ * ring holds audio, so the reader fell more than VIS_BUF_SIZE samples behind.
+ **/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define METRICS_MAGIC   0x3154534d  // "MST1"
+
+struct metrics_t {
+    uint32_t magic;
+    uint32_t seq;           // odd while being updated
+    int32_t pid;
+    uint32_t running;       // cleared when the visualisation stops
+    char program[16];
+
+    uint64_t frames;        // frames rendered
+    uint64_t dropped;       // frames dropped because the output reader was too slow
+    uint64_t overruns;      // times the loop fell more than the ring behind the producer
+    uint64_t torn;          // snapshots of the ring that the producer wrote into during the copy
+    uint64_t retries;       // snapshots that had to be copied again
+    uint32_t rate;          // producer sample rate, from the visualisation buffer
+    int32_t rms;            // current rms_avg of the visualisation
+    int64_t updated;        // producer updated time from the visualisation buffer (s since the epoch)
+    int64_t published;      // monotonic time of this update (ns)
+};
+
+// writer
+struct metrics_t *metrics_open(const char *program);
+void metrics_publish(struct metrics_t *m, long frames, long dropped, int rms);
+void metrics_close(struct metrics_t *m);
+
+// reader
+const struct metrics_t *metrics_map(const char *filename);
+bool metrics_read(const struct metrics_t *m, struct metrics_t *copy);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef MONO_H
+#define MONO_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+// returns the monotonic clock time in ns
+static inline int64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// sleeps until the absolute monotonic time t (in ns)
+static inline void mono_sleep_until(int64_t t)
+{
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000LL;
+    ts.tv_nsec = t % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+#endif
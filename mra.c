@@ -0,0 +1,230 @@
+#include <stdlib.h>     // malloc
+#include <string.h>     // memset, memcpy
+
+#include "fftw3.h"
+
+#include "real.h"
+#include "dsp.h"
+#include "cache.h"
+#include "analysis.h"
+#include "stft.h"
+#include "mra.h"
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+// half-band low-pass filter for the decimation, 1/2 in the middle, 0 at the other even offsets from it
+static const real_t half_band[MRA_TAPS / 2 + 1] = {
+    3.0 / 512, 0, -25.0 / 512, 0, 150.0 / 512, 256.0 / 512
+};
+
+void mra_decimator_reset(struct mra_decimator_t *d)
+{
+    memset(d->tail, 0, sizeof(d->tail));
+    d->odd = false;
+}
+
+// filters count samples at x and decimates them by 2 to out, returns the number of output samples; the
+// MRA_TAPS - 1 places before x are used for the filter tail, so the taps of each output sample are contiguous
+int mra_decimate(struct mra_decimator_t *d, real_t *x, int count, real_t *out)
+{
+    // an output sample for each pair of input samples, ending at the second one
+    real_t *t = x - (MRA_TAPS - 1);
+    memcpy(t, d->tail, sizeof(d->tail));
+    int j;
+    int n = 0;
+    for (j = d->odd ? 0 : 1; j < count; j += 2) {
+        const real_t *p = t + j;
+        out[n++] = half_band[5] * p[5] +
+                   half_band[4] * (p[4] + p[6]) +
+                   half_band[2] * (p[2] + p[8]) +
+                   half_band[0] * (p[0] + p[10]);
+    }
+    memcpy(d->tail, t + count, sizeof(d->tail));
+    d->odd = (d->odd != (count & 1));
+    return n;
+}
+
+// returns the stage a band of count bins of the fft of size n, ending before bin end, is taken from
+static int band_stage(const struct mra_t *r, int count, int end)
+{
+    // the shortest stage with MRA_MIN_BINS bins in the band, or else the longest one
+    int k;
+    for (k = 0; k < MRA_STAGES - 1; k++) {
+        if (count >= MRA_MIN_BINS << (MRA_STAGES - 1 - k)) {
+            break;
+        }
+    }
+    // the decimation filters pass the lower half of the band of a stage cleanly (less than 0.25 dB down, aliases
+    // more than 30 dB down), the band has to be in there
+    while ((k > 0) && ((end << (k + 2)) > r->n)) {
+        k--;
+    }
+    return k;
+}
+
+// takes the bands of the analysis plan from the stages and creates the fft plan for the stages
+bool mra_init(struct mra_t *r, const struct analysis_t *a)
+{
+    int i, k, b;
+    r->n = a->n;
+    r->m = a->n >> (MRA_STAGES - 1);
+    r->resyncs = 0;
+
+    // the same triangular window as the analysis plan
+    for (i = 0; i < r->m; i++) {
+        r->window[i] = (2 * i < r->m) ? (2 * i) : (2 * r->m - 2 * i);
+    }
+
+    for (k = 0; k < MRA_STAGES; k++) {
+        r->stage[k].history = (real_t*) malloc(sizeof(real_t) * r->m);
+        if (!r->stage[k].history) {
+            return false;
+        }
+        r->stage[k].used = false;
+    }
+
+    // power of a band with the stage fft relative to the fft of size n, for both the window length and its
+    // height growing with the fft size
+    real_t ratio = (real_t)r->n / r->m;
+    ratio = ratio * ratio * ratio * ratio;
+    r->nbands = a->nbands;
+    for (b = 0; b < a->nbands; b++) {
+        const struct band_t *band = &a->band[b];
+        struct mra_band_t *mb = &r->band[b];
+        int start = band->start;
+        int end = band->start + band->count;
+        k = band_stage(r, band->count, end);
+        // a stage bin is 2^(stages - 1 - k) bins of the fft of size n, take all those touching the band
+        int shift = MRA_STAGES - 1 - k;
+        mb->stage = k;
+        mb->start = start >> shift;
+        mb->count = ((end + (1 << shift) - 1) >> shift) - mb->start;
+        // a band narrower than its stage bins gets the part of their power that falls in it
+        mb->scale = ratio * band->count / (mb->count << shift);
+        mb->weight = band->weight;
+        r->stage[k].used = true;
+    }
+
+    for (i = 0; i < 2; i++) {
+        r->work[i] = (real_t*) malloc(sizeof(real_t) * (MRA_TAPS - 1 + r->n));
+        if (!r->work[i]) {
+            return false;
+        }
+    }
+
+    r->in = (real_t*) FFTW(malloc)(sizeof(real_t) * r->m);
+    r->out = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * (r->m / 2 + 1));
+    if (!r->in || !r->out) {
+        return false;
+    }
+    r->plan = cache_plan_r2c(r->m, r->in, r->out);
+    if (!r->plan) {
+        return false;
+    }
+    memset(r->in, 0, sizeof(real_t) * r->m);
+    return true;
+}
+
+// empties the histories and filters of all stages
+void mra_reset(struct mra_t *r)
+{
+    int k;
+    for (k = 0; k < MRA_STAGES; k++) {
+        struct mra_stage_t *st = &r->stage[k];
+        memset(st->history, 0, sizeof(real_t) * r->m);
+        st->pos = 0;
+        mra_decimator_reset(&st->decimator);
+    }
+}
+
+// appends count samples to the history of a stage
+static void append(struct mra_t *r, struct mra_stage_t *st, const real_t *src, int count)
+{
+    while (count > 0) {
+        int len = MIN(count, r->m - st->pos);
+        memcpy(st->history + st->pos, src, sizeof(real_t) * len);
+        st->pos = (st->pos + len) % r->m;
+        src += len;
+        count -= len;
+    }
+}
+
+// passes count samples at the full rate down the chain of stages, up to n at a time
+void mra_push(struct mra_t *r, const real_t *src, int count)
+{
+    // the input of a stage, after room for the tail of its decimation filter
+    real_t *x = r->work[0] + MRA_TAPS - 1;
+    real_t *y = r->work[1] + MRA_TAPS - 1;
+    memcpy(x, src, sizeof(real_t) * count);
+    int k;
+    for (k = 0; (k < MRA_STAGES) && (count > 0); k++) {
+        struct mra_stage_t *st = &r->stage[k];
+        append(r, st, x, count);
+        if (k == MRA_STAGES - 1) {
+            break;
+        }
+        // the decimated samples are the input of the next stage
+        count = mra_decimate(&st->decimator, x, count, y);
+        real_t *t = x;
+        x = y;
+        y = t;
+    }
+}
+
+// takes the audio of the hop the stft just took, or all its history when it had to resync
+void mra_follow(struct mra_t *r, const struct stft_t *s)
+{
+    int count = s->hop;
+    if (s->resyncs != r->resyncs) {
+        mra_reset(r);
+        r->resyncs = s->resyncs;
+        count = s->n;
+    }
+    // the newest samples end at pos, in at most two contiguous pieces
+    int start = (s->pos - count + s->n) % s->n;
+    int len = MIN(count, s->n - start);
+    mra_push(r, s->history + start, len);
+    mra_push(r, s->history, count - len);
+}
+
+// transforms the stages and calculates the weighted power of each band, returns the total unweighted power,
+// both on the scale of the fft of size n
+real_t mra_power(struct mra_t *r, real_t power[])
+{
+    int k, b;
+    real_t total = 0.0;
+    for (k = 0; k < MRA_STAGES; k++) {
+        const struct mra_stage_t *st = &r->stage[k];
+        if (!st->used) {
+            continue;
+        }
+        // the oldest sample is at pos, window the history in two contiguous pieces
+        int tail = r->m - st->pos;
+        REAL(dsp_window)(st->history + st->pos, r->window, r->in, tail);
+        REAL(dsp_window)(st->history, r->window + tail, r->in + tail, st->pos);
+        FFTW(execute)(r->plan);
+
+        for (b = 0; b < r->nbands; b++) {
+            const struct mra_band_t *band = &r->band[b];
+            if (band->stage == k) {
+                real_t sum = band->scale * REAL(dsp_sum_squares)(r->out[band->start], 2 * band->count);
+                total += sum;
+                power[b] = band->weight * sum;
+            }
+        }
+    }
+    return total;
+}
+
+void mra_free(struct mra_t *r)
+{
+    int k;
+    FFTW(destroy_plan)(r->plan);
+    FFTW(free)(r->in);
+    FFTW(free)(r->out);
+    for (k = 0; k < MRA_STAGES; k++) {
+        free(r->stage[k].history);
+    }
+    free(r->work[0]);
+    free(r->work[1]);
+}
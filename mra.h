@@ -0,0 +1,80 @@
+/**
+ * Multi-resolution analysis, an alternative to the single long fft for the same display bands.
+ *
+ * The mono audio goes through a chain of stages: stage 0 is the audio itself, every next stage the previous one
+ * low-pass filtered and decimated by 2. Each stage keeps the last m = n/8 samples at its own rate and transforms
+ * them with the same short fft, so stage k resolves as finely as an fft of m * 2^k samples but only covers the
+ * lowest 1/2^k of the spectrum, and the last stage has the resolution of the fft of size n.
+ * Each band of the analysis plan, in bins of the fft of size n, is taken from the shortest stage that gives it
+ * at least MRA_MIN_BINS bins in the lower half of that stage's band, where its decimation filter is clean, so
+ * the high bands follow the audio with a window of m samples and only the bass waits for the long window.
+ *
+ * The audio comes from a stft, which follows the ring: after each hop it takes, mra_follow passes the new
+ * samples down the chain, or refills the chain from the whole history after a resync. mra_push takes blocks of
+ * mono samples directly.
+ **/
+
+#ifndef MRA_H
+#define MRA_H
+
+#include <stdbool.h>
+
+#include "real.h"
+#include "analysis.h"
+#include "stft.h"
+
+#define MRA_STAGES      4
+#define MRA_MAX_M       (ANALYSIS_MAX_N >> (MRA_STAGES - 1))
+// length of the half-band decimation filter
+#define MRA_TAPS        11
+// bins of its stage fft a band should span
+#define MRA_MIN_BINS    8
+
+// a half-band low-pass filter and decimation by 2, over consecutive blocks of samples
+struct mra_decimator_t {
+    real_t tail[MRA_TAPS - 1];      // the last input samples, the start of the filter for the next ones
+    bool odd;                       // whether an odd number of samples went in, the next one completes a pair
+};
+
+struct mra_stage_t {
+    real_t *history;                // the last m samples at the rate of this stage, as a ring starting at pos
+    int pos;
+    struct mra_decimator_t decimator;
+    bool used;                      // whether any band is taken from this stage
+};
+
+// a display band, as a run of bins of one stage
+struct mra_band_t {
+    int stage;
+    int start;
+    int count;
+    real_t scale;                   // converts the summed power to that of the band in the fft of size n
+    real_t weight;                  // the band weight of the analysis plan
+};
+
+struct mra_t {
+    int n;                          // fft size of the analysis plan
+    int m;                          // fft size of the stages
+    real_t window[MRA_MAX_M];
+    struct mra_stage_t stage[MRA_STAGES];
+    int nbands;
+    struct mra_band_t band[ANALYSIS_MAX_BANDS];
+    int resyncs;                    // resyncs of the stft seen so far
+    real_t *work[2];                // the filter tail and new samples of a stage, and the output for the next
+
+    real_t *in;
+    FFTW(complex) *out;
+    FFTW(plan) plan;
+};
+
+void mra_decimator_reset(struct mra_decimator_t *d);
+int mra_decimate(struct mra_decimator_t *d, real_t *x, int count, real_t *out);
+
+bool mra_init(struct mra_t *r, const struct analysis_t *a);
+void mra_reset(struct mra_t *r);
+void mra_push(struct mra_t *r, const real_t *src, int count);
+void mra_follow(struct mra_t *r, const struct stft_t *s);
+real_t mra_power(struct mra_t *r, real_t power[]);
+void mra_free(struct mra_t *r);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>      // fprintf
+#include <string.h>     // memcpy
+#include <pthread.h>
+
+#include "squeeze_vis.h"
+#include "ring.h"
+#include "mono.h"
+#include "wav.h"
+#include "offline.h"
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+bool offline = false;
+
+static struct vis_t vis;
+static struct wav_t wav;
+static int chunk;           // samples written at once
+static long pos;            // stereo frames of the file written so far
+static int64_t audio_ns;    // audio time requested with offline_advance
+static int64_t start;
+
+// reads the WAV file and points vis_mmap at a private visualisation buffer that it is played into
+bool offline_open(const char *filename)
+{
+    if (!wav_read(filename, &wav)) {
+        return false;
+    }
+    if ((wav.frames == 0) || (wav.rate <= 0)) {
+        fprintf(stderr, "%s: no audio\n", filename);
+        return false;
+    }
+
+    pthread_rwlock_init(&vis.rwlock, NULL);
+    vis.buf_size = VIS_BUF_SIZE;
+    vis.buf_index = 0;
+    vis.rate = wav.rate;
+    vis.updated = time(NULL);
+    vis.running = true;
+    vis_mmap = &vis;
+
+    chunk = 2 * (wav.rate / 100);
+    pos = 0;
+    audio_ns = 0;
+    offline = true;
+    start = mono_ns();
+    return true;
+}
+
+// writes the next chunk of the file into the buffer, returns false at the end of the file
+static bool write_chunk(void)
+{
+    int len = MIN(chunk, 2 * (wav.frames - pos));
+    if (len <= 0) {
+        vis.running = false;
+        return false;
+    }
+
+    struct span_t span[2];
+    int n = ring_spans(vis.buf_index, len, span);
+    const s16_t *src = &wav.samples[2 * pos];
+    int i;
+    for (i = 0; i < n; i++) {
+        memcpy((s16_t *)span[i].buf, src, sizeof(s16_t) * span[i].len);
+        src += span[i].len;
+    }
+    vis.buf_index = ring_fix(vis.buf_index + len);
+    vis.updated = time(NULL);
+    pos += len / 2;
+    return true;
+}
+
+// writes chunks until at least 'need' samples are available after read_index or the file ends, returns the
+// number of samples available
+int offline_produce(u32_t read_index, int need)
+{
+    while (ring_avail(read_index) < need) {
+        if (!write_chunk()) {
+            break;
+        }
+    }
+    return ring_avail(read_index);
+}
+
+// writes the audio that plays in the next ns, in whole chunks
+void offline_advance(int64_t ns)
+{
+    audio_ns += ns;
+    long frames = audio_ns * wav.rate / 1000000000LL;
+    while (pos < frames) {
+        if (!write_chunk()) {
+            break;
+        }
+    }
+}
+
+// prints the throughput of the rendering, frames is the number of frames made
+void offline_report(long frames)
+{
+    double seconds = (mono_ns() - start) / 1e9;
+    double audio = (double)pos / wav.rate;
+    fprintf(stderr, "offline: %ld frames from %.1fs of audio in %.3fs, %.0f fps, %.1fx real time\n",
+            frames, audio, seconds, frames / seconds, audio / seconds);
+}
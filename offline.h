@@ -0,0 +1,26 @@
+/**
+ * Offline rendering: audio from a WAV file instead of the squeezelite shared memory, as fast as possible.
+ *
+ * The file is played into a private visualisation buffer with the same layout, so the visualisations run
+ * their normal ring, analysis, render and output paths on it. Instead of sleeping until the producer has
+ * written enough audio, the waits write it there and then, in chunks of 10 ms like squeezelite, and a fixed
+ * frame rate advances the audio by one frame period. The frames are the same on every run, which makes for
+ * throughput benchmarks and for comparing the output of two builds with framediff.
+ **/
+
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "squeeze_vis.h"
+
+extern bool offline;
+
+bool offline_open(const char *filename);
+int offline_produce(u32_t read_index, int need);
+void offline_advance(int64_t ns);
+void offline_report(long frames);
+
+#endif
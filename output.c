@@ -0,0 +1,306 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>     // memcpy, strcmp
+#include <stdio.h>      // perror
+#include <stdlib.h>     // atexit
+#include <unistd.h>     // write
+#include <fcntl.h>      // fcntl
+#include <signal.h>     // signal, raise
+#include <sys/stat.h>   // fstat
+#include <errno.h>
+
+#include "pixel.h"
+#include "fb.h"
+#include "mono.h"
+#include "prof.h"
+#include "output.h"
+
+// changes separated by no more than this many unchanged bytes are sent as one span
+#define SPAN_MERGE_GAP  4
+
+static int encoding = OUTPUT_RAW;
+static struct fb_t *fb;                 // shared-memory framebuffer, or NULL for stdout
+static int rgb_size;
+static int frame_size;
+static uint8_t packed[OUTPUT_MAX_SIZE];
+static uint8_t prev[OUTPUT_MAX_SIZE];    // the last frame that was sent
+static int since_key;
+
+// the newest frame that has not been sent yet, as drawn
+static uint8_t pending[OUTPUT_MAX_SIZE];
+static bool have_pending;
+static int64_t pending_audio;
+
+// packet being sent, largest is a keyframe, or a delta just smaller than that
+static uint8_t packet[3 + OUTPUT_MAX_SIZE];
+static int packet_len;
+static int packet_pos;
+static int64_t packet_audio;            // time the newest audio in the packet was written, 0 if not known
+
+// statistics
+static int stat_bytes;
+static int stat_keyframes;
+static int stat_dropped;
+static int stat_partial;
+static long total_dropped;
+
+// file status flags of stdout before it was made non-blocking, -1 if it was left alone
+static int stdout_flags = -1;
+
+// gives stdout back its original flags, the open file may be shared with other processes
+static void restore_stdout(void)
+{
+    if (stdout_flags >= 0) {
+        fcntl(1, F_SETFL, stdout_flags);
+    }
+}
+
+// restores stdout when killed, then dies of the signal as usual
+static void restore_on_signal(int sig)
+{
+    restore_stdout();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// sets up the output of width x height rgb888 frames, packed into the given pixel format with the given
+// dithering, to stdout in the given encoding, or to a shared-memory framebuffer if filename is not NULL
+bool output_init(int enc, int format, int dither, int width, int height, const char *filename)
+{
+    if (!pixel_init(format, dither, width, height)) {
+        return false;
+    }
+    int size = pixel_frame_size();
+    if ((size <= 0) || (width * height * 3 > OUTPUT_MAX_SIZE)) {
+        return false;
+    }
+    encoding = enc;
+    rgb_size = width * height * 3;
+    frame_size = size;
+    since_key = OUTPUT_KEY_INTERVAL;
+    have_pending = false;
+    packet_len = 0;
+    packet_pos = 0;
+
+    if (filename != NULL) {
+        if (enc != OUTPUT_RAW) {
+            fprintf(stderr, "the framebuffer takes raw frames only\n");
+            return false;
+        }
+        fb = fb_create(filename, width, height, format, size);
+        return (fb != NULL);
+    }
+
+    // a slow reader must not block the visualisation; only a pipe or socket is made non-blocking, a terminal
+    // shares its open file with stderr and the shell, and a file does not hold up the writer
+    struct stat st;
+    if (fstat(1, &st) < 0) {
+        perror("fstat failed");
+        return false;
+    }
+    if (!S_ISFIFO(st.st_mode) && !S_ISSOCK(st.st_mode)) {
+        return true;
+    }
+    int flags = fcntl(1, F_GETFL);
+    if ((flags < 0) || (fcntl(1, F_SETFL, flags | O_NONBLOCK) < 0)) {
+        perror("fcntl failed");
+        return false;
+    }
+    stdout_flags = flags;
+    atexit(restore_stdout);
+    signal(SIGINT, restore_on_signal);
+    signal(SIGTERM, restore_on_signal);
+    signal(SIGHUP, restore_on_signal);
+    return true;
+}
+
+// returns the encoding with the given name (raw or delta), or -1
+int output_encoding(const char *name)
+{
+    if (strcmp(name, "raw") == 0) {
+        return OUTPUT_RAW;
+    }
+    if (strcmp(name, "delta") == 0) {
+        return OUTPUT_DELTA;
+    }
+    return -1;
+}
+
+static void put_u16(uint8_t *p, int v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+// encodes the changes from prev to frame as a delta packet, returns its length, or 0 if it would not be
+// smaller than a keyframe
+static int encode_delta(const uint8_t *frame)
+{
+    const int limit = 3 + frame_size;
+    int len = 3;
+    int spans = 0;
+    int i = 0;
+    while (i < frame_size) {
+        // find the next change
+        if (frame[i] == prev[i]) {
+            i++;
+            continue;
+        }
+
+        // extend the span until a long enough run of unchanged bytes
+        int start = i;
+        int end = i + 1;
+        int j;
+        for (j = end; (j < frame_size) && (j - end <= SPAN_MERGE_GAP); j++) {
+            if (frame[j] != prev[j]) {
+                end = j + 1;
+            }
+        }
+
+        int span = end - start;
+        if (len + 4 + span >= limit) {
+            return 0;
+        }
+        put_u16(&packet[len], start);
+        put_u16(&packet[len + 2], span);
+        memcpy(&packet[len + 4], &frame[start], span);
+        len += 4 + span;
+        spans++;
+        i = end;
+    }
+    packet[0] = OUTPUT_DELTAFRAME;
+    put_u16(&packet[1], spans);
+    return len;
+}
+
+// packs the pending frame and encodes it against the last frame sent, into the packet
+static void encode(void)
+{
+    pixel_pack(pending, packed);
+    have_pending = false;
+    packet_audio = pending_audio;
+
+    int len = 0;
+    if (encoding == OUTPUT_RAW) {
+        memcpy(packet, packed, frame_size);
+        len = frame_size;
+    } else {
+        if (since_key < OUTPUT_KEY_INTERVAL) {
+            len = encode_delta(packed);
+        }
+        if (len == 0) {
+            packet[0] = OUTPUT_KEYFRAME;
+            put_u16(&packet[1], frame_size);
+            memcpy(&packet[3], packed, frame_size);
+            len = 3 + frame_size;
+            since_key = 0;
+            stat_keyframes++;
+        }
+        since_key++;
+    }
+    memcpy(prev, packed, frame_size);
+    packet_len = len;
+    packet_pos = 0;
+}
+
+// writes as much as stdout takes without blocking: the rest of the packet being sent, then the pending frame,
+// returns false if the output is gone
+bool output_flush(void)
+{
+    for (;;) {
+        if (packet_pos == packet_len) {
+            if (!have_pending) {
+                return true;
+            }
+            encode();
+        }
+
+        ssize_t n = write(1, &packet[packet_pos], packet_len - packet_pos);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                // the reader is busy, the rest goes out on a later flush
+                return true;
+            }
+            perror("write failed");
+            return false;
+        }
+        if (n < packet_len - packet_pos) {
+            stat_partial++;
+        }
+        packet_pos += n;
+        stat_bytes += n;
+        if ((packet_pos == packet_len) && (packet_audio > 0)) {
+            // the frame is out, measure its audio-to-light latency
+            prof_add(PROF_LATENCY, mono_ns() - packet_audio);
+        }
+    }
+}
+
+// queues a frame for output to stdout and sends what can be sent without blocking, a queued frame that was
+// not sent yet is replaced by the newer one; audio is the time the newest audio it shows was written, or 0
+void output_frame(const uint8_t *rgb, int64_t audio)
+{
+    if (fb != NULL) {
+        // pack straight into the framebuffer, readers never hold up the writer
+        pixel_pack(rgb, fb_back(fb));
+        fb_publish(fb);
+        stat_bytes += frame_size;
+        if (audio > 0) {
+            prof_add(PROF_LATENCY, mono_ns() - audio);
+        }
+        return;
+    }
+
+    if (have_pending) {
+        stat_dropped++;
+        total_dropped++;
+    }
+    memcpy(pending, rgb, rgb_size);
+    have_pending = true;
+    pending_audio = audio;
+    output_flush();
+}
+
+// makes writes to stdout wait for the reader, so no frame is dropped, e.g. when rendering offline
+void output_blocking(void)
+{
+    if (stdout_flags >= 0) {
+        fcntl(1, F_SETFL, stdout_flags & ~O_NONBLOCK);
+    }
+}
+
+// sends the remaining output, blocking until it is written, e.g. before exit
+void output_close(void)
+{
+    if (fb != NULL) {
+        fb_close(fb);
+        fb = NULL;
+        return;
+    }
+
+    output_blocking();
+    output_flush();
+}
+
+// returns the number of bytes and keyframes written, the frames dropped because the reader was too slow, and
+// the writes that stdout took only part of, since the previous call
+void output_stats(int *bytes, int *keyframes, int *dropped, int *partial)
+{
+    *bytes = stat_bytes;
+    *keyframes = stat_keyframes;
+    *dropped = stat_dropped;
+    *partial = stat_partial;
+    stat_bytes = 0;
+    stat_keyframes = 0;
+    stat_dropped = 0;
+    stat_partial = 0;
+}
+
+// returns the number of frames dropped since the start
+long output_dropped(void)
+{
+    return total_dropped;
+}
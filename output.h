@@ -0,0 +1,53 @@
+/**
+ * Output of frames to stdout, raw or delta encoded.
+ *
+ * Frames are first packed into the pixel format of the output (see pixel.h), the encoding works on the packed
+ * bytes.
+ * Raw: every packed frame is written as is, e.g. WIDTH x HEIGHT x 3 bytes for rgb888.
+ *
+ * Delta: every frame is written as one packet, all 16-bit values little-endian:
+ * - keyframe: 'K', u16 frame size, the frame
+ * - delta:    'D', u16 number of spans, then per span: u16 offset, u16 length, the new bytes
+ *   The spans hold the bytes that changed since the previous frame, a frame without changes is
+ *   a delta with 0 spans. Changes close together are sent as one span, as the span header costs 4 bytes.
+ * A keyframe is sent first, every OUTPUT_KEY_INTERVAL frames, and whenever a delta would not be smaller,
+ * so a decoder that starts late or loses bytes recovers at the next keyframe.
+ * bannerdec.c is the reference decoder, it turns the stream back into raw (packed) frames.
+ *
+ * When stdout is a pipe or socket it is made non-blocking, so a slow reader does not hold up the
+ * visualisation; its original flags are restored at exit, also when killed by SIGINT, SIGTERM or SIGHUP.
+ * A terminal or file is left blocking, as its open file may be shared with stderr. A packet is always written
+ * completely, over as many writes as it takes, so partial writes cannot break the frame alignment. At most
+ * one more frame waits behind it; a newer frame replaces it and counts as dropped. The waiting frame is
+ * only packed and encoded once it is sent, so a delta is always against the last frame actually sent.
+ *
+ * Instead of stdout, frames can go to a shared-memory framebuffer (see fb.h), they are then packed straight
+ * into it without any system call or copy.
+ **/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OUTPUT_RAW      0
+#define OUTPUT_DELTA    1
+
+#define OUTPUT_MAX_SIZE     65535
+#define OUTPUT_KEY_INTERVAL 100
+
+// packet types of the delta encoding
+#define OUTPUT_KEYFRAME 'K'
+#define OUTPUT_DELTAFRAME 'D'
+
+bool output_init(int encoding, int format, int dither, int width, int height, const char *filename);
+int output_encoding(const char *name);
+void output_frame(const uint8_t *rgb, int64_t audio);
+bool output_flush(void);
+void output_blocking(void);
+void output_close(void);
+long output_dropped(void);
+void output_stats(int *bytes, int *keyframes, int *dropped, int *partial);
+
+#endif
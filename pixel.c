@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>     // strcmp
+#include <math.h>       // floor
+
+#include "pixel.h"
+
+static const uint8_t bayer[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+static int format = PIXEL_RGB888;
+static int dither = DITHER_NONE;
+static int width;
+static int height;
+static int phase;               // position of the matrix, for temporal dithering
+
+// reduced channel value for each channel, threshold and 8-bit value
+static uint8_t quant[3][16][256];
+
+// returns the number of bits of channel c in the current format
+static int channel_bits(int c)
+{
+    switch (format) {
+    case PIXEL_RGB565:
+        return (c == 1) ? 6 : 5;
+    case PIXEL_RGB444:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+// sets up packing of width x height frames into the given format, with the given dithering
+bool pixel_init(int fmt, int dith, int w, int h)
+{
+    if ((fmt < PIXEL_RGB888) || (fmt > PIXEL_RGB444) || (dith < DITHER_NONE) || (dith > DITHER_TEMPORAL)) {
+        return false;
+    }
+    // rgb444 packs pairs of pixels in a row
+    if ((fmt == PIXEL_RGB444) && (w % 2 != 0)) {
+        return false;
+    }
+    format = fmt;
+    dither = dith;
+    width = w;
+    height = h;
+    phase = 0;
+
+    // value * max / 255, rounded with threshold (t + 0.5) / 16 when dithering, or to nearest otherwise
+    int c, t, v;
+    for (c = 0; c < 3; c++) {
+        int max = (1 << channel_bits(c)) - 1;
+        for (t = 0; t < 16; t++) {
+            double threshold = (dither == DITHER_NONE) ? 0.5 : (t + 0.5) / 16.0;
+            for (v = 0; v < 256; v++) {
+                int q = floor(v * max / 255.0 + threshold);
+                quant[c][t][v] = (q > max) ? max : q;
+            }
+        }
+    }
+    return true;
+}
+
+// returns the pixel format with the given name, or -1
+int pixel_format(const char *name)
+{
+    if (strcmp(name, "rgb888") == 0) {
+        return PIXEL_RGB888;
+    }
+    if (strcmp(name, "rgb565") == 0) {
+        return PIXEL_RGB565;
+    }
+    if (strcmp(name, "rgb444") == 0) {
+        return PIXEL_RGB444;
+    }
+    return -1;
+}
+
+// returns the dithering with the given name, or -1
+int pixel_dither(const char *name)
+{
+    if (strcmp(name, "none") == 0) {
+        return DITHER_NONE;
+    }
+    if (strcmp(name, "bayer") == 0) {
+        return DITHER_BAYER;
+    }
+    if (strcmp(name, "temporal") == 0) {
+        return DITHER_TEMPORAL;
+    }
+    return -1;
+}
+
+// returns the size of a packed frame in bytes
+int pixel_frame_size(void)
+{
+    switch (format) {
+    case PIXEL_RGB565:
+        return width * height * 2;
+    case PIXEL_RGB444:
+        return width * height * 3 / 2;
+    default:
+        return width * height * 3;
+    }
+}
+
+// packs a frame of rgb888 pixels into dst in the current format
+void pixel_pack(const uint8_t *rgb, uint8_t *dst)
+{
+    // for temporal dithering the matrix moves one column per frame, and one row every 4 frames
+    int dx = 0;
+    int dy = 0;
+    if (dither == DITHER_TEMPORAL) {
+        dx = phase & 3;
+        dy = phase >> 2;
+        phase = (phase + 1) & 15;
+    }
+
+    int x, y;
+    if (format == PIXEL_RGB565) {
+        for (y = 0; y < height; y++) {
+            const uint8_t *row = bayer[(y + dy) & 3];
+            for (x = 0; x < width; x++) {
+                int t = row[(x + dx) & 3];
+                int v = (quant[0][t][rgb[0]] << 11) | (quant[1][t][rgb[1]] << 5) | quant[2][t][rgb[2]];
+                dst[0] = v & 0xFF;
+                dst[1] = v >> 8;
+                rgb += 3;
+                dst += 2;
+            }
+        }
+    } else if (format == PIXEL_RGB444) {
+        for (y = 0; y < height; y++) {
+            const uint8_t *row = bayer[(y + dy) & 3];
+            for (x = 0; x < width; x += 2) {
+                int t0 = row[(x + dx) & 3];
+                int t1 = row[(x + 1 + dx) & 3];
+                dst[0] = (quant[0][t0][rgb[0]] << 4) | quant[1][t0][rgb[1]];
+                dst[1] = (quant[2][t0][rgb[2]] << 4) | quant[0][t1][rgb[3]];
+                dst[2] = (quant[1][t1][rgb[4]] << 4) | quant[2][t1][rgb[5]];
+                rgb += 6;
+                dst += 3;
+            }
+        }
+    } else {
+        memcpy(dst, rgb, width * height * 3);
+    }
+}
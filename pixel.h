@@ -0,0 +1,34 @@
+/**
+ * Packed pixel formats for the output, for led controllers that cannot show 24-bit colour anyway.
+ *
+ * - rgb888: 3 bytes per pixel, r, g, b (the frames as drawn)
+ * - rgb565: 2 bytes per pixel, a little-endian u16 with red in the top 5 bits, then 6 bits green, 5 bits blue
+ * - rgb444: 3 bytes per 2 pixels of a row, nibbles r0 g0, b0 r1, g1 b1 (high nibble first), needs an even width
+ *
+ * Channels are reduced with table lookups. Ordered dithering uses a 4x4 Bayer matrix as the rounding threshold
+ * of each pixel, so palette gradients do not band. Temporal dithering also moves the matrix every frame, so each
+ * pixel goes through all 16 thresholds in 16 frames and averages out to the original colour over time. That
+ * makes static images change every frame, which costs the delta encoding most of its gain.
+ **/
+
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIXEL_RGB888    0
+#define PIXEL_RGB565    1
+#define PIXEL_RGB444    2
+
+#define DITHER_NONE     0
+#define DITHER_BAYER    1
+#define DITHER_TEMPORAL 2
+
+bool pixel_init(int format, int dither, int width, int height);
+int pixel_format(const char *name);
+int pixel_dither(const char *name);
+int pixel_frame_size(void);
+void pixel_pack(const uint8_t *rgb, uint8_t *dst);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdio.h>      // perror
+#include <unistd.h>     // sysconf
+#include <pthread.h>
+
+#include "pool.h"
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+static int threads = 1;
+static pthread_t worker[POOL_MAX_THREADS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+// the current job
+static pool_job_t *job;
+static void *job_ctx;
+static int job_items;
+static unsigned generation;     // incremented for each job
+static int pending;             // workers still busy with the current job
+
+// runs part p of the current job
+static void run_part(int p)
+{
+    int start = (long)job_items * p / threads;
+    int end = (long)job_items * (p + 1) / threads;
+    if (start < end) {
+        job(job_ctx, start, end);
+    }
+}
+
+static void *work(void *arg)
+{
+    int p = (long)arg;
+    unsigned seen = 0;
+    for (;;) {
+        // sleep until the next job, frames are too far apart for polling to pay off
+        pthread_mutex_lock(&lock);
+        while (generation == seen) {
+            pthread_cond_wait(&start_cond, &lock);
+        }
+        seen = generation;
+        pthread_mutex_unlock(&lock);
+
+        run_part(p);
+
+        pthread_mutex_lock(&lock);
+        if (--pending == 0) {
+            pthread_cond_signal(&done_cond);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+// starts the workers: threads is the number of threads rendering, including the caller, 0 to choose from
+// the number of cores and the panel size in pixels
+bool pool_init(int n, int pixels)
+{
+    if (n == 0) {
+        n = (pixels >= POOL_MIN_PIXELS) ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    }
+    n = MIN(n, POOL_MAX_THREADS);
+    threads = 1;
+    for (; threads < n; threads++) {
+        if (pthread_create(&worker[threads], NULL, work, (void *)(long)threads) != 0) {
+            perror("pthread_create failed");
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns the number of threads rendering, including the caller
+int pool_threads(void)
+{
+    return threads;
+}
+
+// runs a job over the given number of items on all threads, returns when it is done
+void pool_run(pool_job_t *fn, void *ctx, int items)
+{
+    if ((threads == 1) || (items < 2)) {
+        fn(ctx, 0, items);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    job = fn;
+    job_ctx = ctx;
+    job_items = items;
+    pending = threads - 1;
+    generation++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&lock);
+
+    run_part(0);
+
+    pthread_mutex_lock(&lock);
+    while (pending > 0) {
+        pthread_cond_wait(&done_cond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
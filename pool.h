@@ -0,0 +1,28 @@
+/**
+ * Small persistent pool of worker threads for rendering large panels.
+ *
+ * pool_run splits a job over a number of items (rows of the frame) into one contiguous part per thread,
+ * runs the parts on the workers and on the calling thread, and returns when all are done, so the threads
+ * synchronise once per frame. The parts must write disjoint pixels, the frames are then the same as
+ * rendered on one thread. Between jobs the workers sleep on a condition variable.
+ *
+ * Panels smaller than POOL_MIN_PIXELS get no workers by default: rendering them takes less time than
+ * waking a thread, so pool_run then just calls the job on the calling thread.
+ **/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+
+#define POOL_MAX_THREADS    16
+#define POOL_MIN_PIXELS     8192
+
+// renders items start..end-1 of a job
+typedef void pool_job_t(void *ctx, int start, int end);
+
+bool pool_init(int threads, int pixels);
+int pool_threads(void);
+void pool_run(pool_job_t *job, void *ctx, int items);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdio.h>      // fprintf
+#include <string.h>     // memset
+
+#include "mono.h"
+#include "prof.h"
+
+// four buckets per octave of ns
+#define BUCKETS     (4 * 36)
+
+static const char *names[PROF_STAGES] = { "wait", "ingest", "analyse", "map", "render", "output", "latency" };
+
+static int hist[PROF_STAGES][BUCKETS];
+static int count[PROF_STAGES];
+static int64_t max[PROF_STAGES];
+static int64_t last;
+
+// returns the bucket of a time in ns
+static int bucket(int64_t ns)
+{
+    if (ns < 4) {
+        return (ns < 0) ? 0 : ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int b = 4 * (msb - 1) + ((ns >> (msb - 2)) & 3);
+    return (b < BUCKETS) ? b : BUCKETS - 1;
+}
+
+// returns the upper edge of a bucket in ns
+static int64_t bucket_end(int b)
+{
+    if (b < 4) {
+        return b + 1;
+    }
+    int msb = b / 4 + 1;
+    return (int64_t)(4 + (b & 3) + 1) << (msb - 2);
+}
+
+// returns the time below which the given fraction of the samples of a stage falls, in ns
+static int64_t percentile(int stage, double fraction)
+{
+    int rank = fraction * count[stage];
+    int sum = 0;
+    int b;
+    for (b = 0; b < BUCKETS; b++) {
+        sum += hist[stage][b];
+        if (sum > rank) {
+            break;
+        }
+    }
+    int64_t end = bucket_end(b);
+    return (end < max[stage]) ? end : max[stage];
+}
+
+// marks the start of the first stage
+void prof_start(void)
+{
+    last = mono_ns();
+}
+
+// adds a time in ns to the histogram of a stage
+void prof_add(int stage, int64_t ns)
+{
+    hist[stage][bucket(ns)]++;
+    count[stage]++;
+    if (ns > max[stage]) {
+        max[stage] = ns;
+    }
+}
+
+// marks the end of a stage, which started at the previous mark
+void prof_lap(int stage)
+{
+    int64_t now = mono_ns();
+    prof_add(stage, now - last);
+    last = now;
+}
+
+// prints the percentiles of each stage since the previous call, and starts again
+void prof_dump(FILE *f)
+{
+    int stage;
+    fprintf(f, "prof");
+    for (stage = 0; stage < PROF_STAGES; stage++) {
+        if (count[stage] > 0) {
+            fprintf(f, " %s=%lld/%lld/%lld", names[stage], (long long)(percentile(stage, 0.5) + 999) / 1000,
+                    (long long)(percentile(stage, 0.99) + 999) / 1000, (long long)(max[stage] + 999) / 1000);
+        }
+    }
+    fprintf(f, "\n");
+
+    memset(hist, 0, sizeof(hist));
+    memset(count, 0, sizeof(count));
+    memset(max, 0, sizeof(max));
+}
@@ -0,0 +1,36 @@
+/**
+ * Per-stage timing of the frame loop, as histograms.
+ *
+ * The loop marks the end of each stage with prof_lap, which adds the time since the previous mark to the
+ * histogram of that stage. Histograms have fixed buckets, the four equal quarters of each octave from 1 ns up
+ * to minutes (e.g. [8,10), [10,12), [12,14), [14,16) ns), so recording a time is a few instructions and no
+ * allocation.
+ *
+ * prof_dump prints one line with the 50th and 99th percentile and maximum of each stage in us, e.g.
+ *   prof wait=812/1503/1620 ingest=6/9/12 analyse=31/44/60 map=3/4/5 render=2/3/4 output=9/22/27 latency=...
+ * leaving out stages without samples. Percentiles are the upper edge of their bucket, so up to 25% high, for
+ * a time at the start of an octave.
+ **/
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROF_WAIT       0   // waiting for the next frame
+#define PROF_INGEST     1   // copying (and unwrapping) audio out of the ring
+#define PROF_ANALYSE    2   // fft, correlation or rms
+#define PROF_MAP        3   // mapping fft bins onto display bands
+#define PROF_RENDER     4   // drawing the frame
+#define PROF_OUTPUT     5   // packing, encoding and writing the frame
+#define PROF_LATENCY    6   // from the newest audio of a frame being written by the producer to the frame
+                            // being written out, recorded with prof_add
+#define PROF_STAGES     7
+
+void prof_start(void);
+void prof_lap(int stage);
+void prof_add(int stage, int64_t ns);
+void prof_dump(FILE *f);
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * Precision of the analysis chain: double by default, single precision (fftwf, float buffers and float
+ * accumulation) when built with USE_FLOAT, e.g. for ARM targets with a single-precision FPU or NEON.
+ *
+ * FFTW(name) selects the matching FFTW function or type, REAL(name) the matching float variant of a
+ * double function from libm or the dsp kernels (e.g. sqrt / sqrtf).
+ **/
+
+#ifndef REAL_H
+#define REAL_H
+
+#include "fftw3.h"
+
+#ifdef USE_FLOAT
+typedef float real_t;
+#define FFTW(name)  fftwf_##name
+#define REAL(name)  name##f
+#else
+typedef double real_t;
+#define FFTW(name)  fftw_##name
+#define REAL(name)  name
+#endif
+
+#endif
+
@@ -0,0 +1,106 @@
+#include <stdio.h>      // perror
+#include <string.h>     // memcpy
+#include <sys/mman.h>   // MAP_FAILED
+#include <fcntl.h>      // open
+
+#include "squeeze_vis.h"
+#include "ring.h"
+
+struct vis_t *vis_mmap = NULL;
+struct ring_stats_t ring_stats;
+
+// mmap the file, writable is needed only to take the rwlock in it
+bool vis_open(const char *filename, bool writable)
+{
+    int vis_fd;
+
+    vis_fd = open(filename, writable ? O_RDWR : O_RDONLY, 0);
+    if (vis_fd <= 0) {
+        perror("open failed");
+        return false;
+    }
+
+    int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), prot, MAP_SHARED, vis_fd, 0);
+    if (vis_mmap == MAP_FAILED) {
+        perror("mmap failed");
+        return false;
+    }
+
+    return true;
+}
+
+// splits the window of len samples starting at offset start into at most two spans, returns the number of spans
+int ring_spans(u32_t start, int len, struct span_t span[2])
+{
+    start = ring_fix(start);
+    int first = VIS_BUF_SIZE - start;
+    if (len <= first) {
+        span[0].buf = &vis_mmap->buffer[start];
+        span[0].len = len;
+        return 1;
+    }
+    span[0].buf = &vis_mmap->buffer[start];
+    span[0].len = first;
+    span[1].buf = &vis_mmap->buffer[0];
+    span[1].len = len - first;
+    return 2;
+}
+
+// copies the window of len samples starting at offset start to dst
+void ring_copy(u32_t start, int len, s16_t *dst)
+{
+    struct span_t span[2];
+    int n = ring_spans(start, len, span);
+    int i;
+    for (i = 0; i < n; i++) {
+        memcpy(dst, span[i].buf, sizeof(s16_t) * span[i].len);
+        dst += span[i].len;
+    }
+}
+
+// returns the number of samples at the start of the window of len samples ending at offset end that the
+// writer may have overwritten while it advanced from offset 'before' to offset 'after'
+static int torn_samples(u32_t end, int len, u32_t before, u32_t after)
+{
+    // a sample d samples behind 'before' is overwritten once the writer has advanced VIS_BUF_SIZE - d
+    int behind = ring_distance(end, before) + len;
+    int advanced = ring_distance(before, after) + RING_GUARD;
+    int torn = behind + advanced - VIS_BUF_SIZE;
+    if (torn < 0) {
+        return 0;
+    }
+    return (torn < len) ? torn : len;
+}
+
+// copies the len samples ending at offset *end to dst without taking the lock, checking the writer progress;
+// if fewer than 'need' of the newest samples survived the copy, *end is moved up to the newest data and the
+// copy is retried; returns the number of valid samples at the end of dst, or 0 if no clean copy was made
+int ring_snapshot(u32_t *end, int len, int need, s16_t *dst)
+{
+    int attempt;
+    ring_stats.snapshots++;
+    for (attempt = 0; attempt <= RING_RETRIES; attempt++) {
+        u32_t before = __atomic_load_n(&vis_mmap->buf_index, __ATOMIC_ACQUIRE);
+        ring_copy(*end - len, len, dst);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        u32_t after = __atomic_load_n(&vis_mmap->buf_index, __ATOMIC_RELAXED);
+
+        int torn = torn_samples(*end, len, before, after);
+        if (torn == 0) {
+            return len;
+        }
+        if (attempt == 0) {
+            ring_stats.torn++;
+        }
+        if ((len - torn) >= need) {
+            // only old samples were overwritten, trim them
+            return len - torn;
+        }
+
+        // we fell too far behind, move up to the newest data and try again
+        ring_stats.retries++;
+        *end = after;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * Reader for the squeezelite visualisation ring buffer.
+ *
+ * A window of the ring is returned as at most two contiguous spans of interleaved stereo s16 samples,
+ * pointing directly into the shared memory, so consumers can run tight loops over them or take a
+ * snapshot with one or two memcpy calls, without per-sample offset wrapping.
+ *
+ * Snapshots are lock-free and tear-free, in the style of a seqlock: buf_index is read before and after
+ * the copy, and the part of the window the writer may have overwritten in the meantime is derived from how
+ * far it advanced. A clean copy is accepted, a copy with only an old part overwritten can be trimmed, and
+ * otherwise the window is moved up to the newest data and copied again.
+ **/
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+
+#include "squeeze_vis.h"
+
+// the offset wrapping below relies on this
+#if (VIS_BUF_SIZE & (VIS_BUF_SIZE - 1)) != 0
+#error "VIS_BUF_SIZE must be a power of two"
+#endif
+
+// samples beyond the published buf_index that the producer may be writing at any time
+#define RING_GUARD      2048
+// number of times a torn snapshot is retried
+#define RING_RETRIES    3
+
+// a contiguous piece of the ring buffer
+struct span_t {
+    const s16_t *buf;
+    int len;
+};
+
+// snapshot statistics
+struct ring_stats_t {
+    int snapshots;
+    int torn;       // snapshots in which the writer overwrote part of the window during the copy
+    int retries;    // copies that had to be done again because too much of the window was overwritten
+};
+
+extern struct ring_stats_t ring_stats;
+
+// fixes an offset in the visualisation buffer to the range 0..VIS_BUF_SIZE-1
+static inline u32_t ring_fix(u32_t offset)
+{
+    return offset & (VIS_BUF_SIZE - 1);
+}
+
+// returns the number of samples from offset 'from' to offset 'to'
+static inline int ring_distance(u32_t from, u32_t to)
+{
+    return ring_fix(to - from);
+}
+
+// returns the number of samples the producer has written after offset read_index
+static inline int ring_avail(u32_t read_index)
+{
+    return ring_distance(read_index, vis_mmap->buf_index);
+}
+
+bool vis_open(const char *filename, bool writable);
+int ring_spans(u32_t start, int len, struct span_t span[2]);
+void ring_copy(u32_t start, int len, s16_t *dst);
+int ring_snapshot(u32_t *end, int len, int need, s16_t *dst);
+
+#endif
+
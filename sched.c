@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <stdlib.h>     // llabs
+
+#include "squeeze_vis.h"
+#include "mono.h"
+#include "ingest.h"
+#include "sched.h"
+#include "offline.h"
+
+// initialises the scheduler for fps frames per second, or for frames following the audio if fps is 0
+void sched_init(struct sched_t *s, int fps)
+{
+    s->period = (fps > 0) ? 1000000000LL / fps : 0;
+    s->next = mono_ns() + s->period;
+    s->last_frame = 0;
+    s->interval = s->period;
+    s->total = 0;
+
+    s->waits = 0;
+    s->frames = 0;
+    s->skipped = 0;
+    s->late_sum = 0;
+    s->jitter_sum = 0;
+    s->jitter_max = 0;
+}
+
+// sleeps until the next frame is due: the next deadline at a fixed frame rate, otherwise until at least
+// 'need' samples are available after read_index
+void sched_wait(struct sched_t *s, struct ingest_t *ing, u32_t read_index, int need)
+{
+    if (s->period == 0) {
+        ingest_wait(ing, read_index, need);
+        return;
+    }
+    if (offline) {
+        // no waiting, the audio of one frame period is written instead
+        offline_advance(s->period);
+        return;
+    }
+
+    // while the producer clock is not known precisely, look at the producer index in between frames
+    int64_t probe = ingest_probe(ing, s->next);
+    if (probe > 0) {
+        mono_sleep_until(probe);
+        ing->wakeups++;
+        ingest_observe(ing);
+    }
+    mono_sleep_until(s->next);
+    ing->wakeups++;
+    int64_t now = mono_ns();
+    ingest_observe(ing);
+    s->late_sum += now - s->next;
+    s->waits++;
+
+    // next deadline, skipping the ones that have already passed
+    s->next += s->period;
+    if (s->next <= now) {
+        int64_t missed = (now - s->next) / s->period + 1;
+        s->next += missed * s->period;
+        s->skipped += missed;
+    }
+}
+
+// records that a frame was output, for the jitter statistics
+void sched_frame(struct sched_t *s)
+{
+    int64_t now = mono_ns();
+    s->total++;
+    if (s->last_frame > 0) {
+        int64_t interval = now - s->last_frame;
+        if (s->period == 0) {
+            // no fixed period, follow the average interval with a 1-pole filter
+            s->interval += (interval - s->interval) / 16;
+        }
+        int64_t jitter = llabs(interval - s->interval);
+        s->jitter_sum += jitter;
+        if (jitter > s->jitter_max) {
+            s->jitter_max = jitter;
+        }
+        s->frames++;
+    }
+    s->last_frame = now;
+}
+
+// returns the average and maximum frame jitter and the average lateness of the wakeups since the previous
+// call, in us, and the number of skipped deadlines
+void sched_stats(struct sched_t *s, int *jitter_us, int *jitter_max_us, int *late_us, int *skipped)
+{
+    *jitter_us = (s->frames > 0) ? s->jitter_sum / s->frames / 1000 : 0;
+    *jitter_max_us = s->jitter_max / 1000;
+    *late_us = (s->waits > 0) ? s->late_sum / s->waits / 1000 : 0;
+    *skipped = s->skipped;
+
+    s->waits = 0;
+    s->frames = 0;
+    s->skipped = 0;
+    s->late_sum = 0;
+    s->jitter_sum = 0;
+    s->jitter_max = 0;
+}
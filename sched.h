@@ -0,0 +1,43 @@
+/**
+ * Frame scheduler shared by the visualisations.
+ *
+ * At a fixed frame rate, frames are made at absolute deadlines on the monotonic clock, each one period
+ * after the previous deadline, so the time spent on a frame does not make the rate drift. Deadlines that
+ * were missed entirely are skipped rather than made up for with a burst of frames. While the ingest does not
+ * know the producer clock precisely enough to date the audio, it also wakes once in between to look at the
+ * producer index (see ingest.h).
+ * At frame rate 0, a frame is made whenever a new block of audio arrives, using the ingest predictions.
+ * Either way the interval between frames is measured, to report the jitter of the led refresh.
+ * When rendering offline, nothing is waited for: the audio needed for the next frame is written instead.
+ **/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#include "squeeze_vis.h"
+#include "ingest.h"
+
+struct sched_t {
+    int64_t period;         // ns between frames, 0 when frames follow the audio
+    int64_t next;           // absolute deadline of the next frame
+    int64_t last_frame;     // time of the previous frame
+    int64_t interval;       // average interval between frames (ns)
+    long total;             // frames made since the start
+
+    // statistics
+    int waits;
+    int frames;
+    int skipped;            // deadlines that were missed entirely
+    int64_t late_sum;       // time woken up after the deadlines
+    int64_t jitter_sum;     // deviation of the frame intervals from the period
+    int64_t jitter_max;
+};
+
+void sched_init(struct sched_t *s, int fps);
+void sched_wait(struct sched_t *s, struct ingest_t *ing, u32_t read_index, int need);
+void sched_frame(struct sched_t *s);
+void sched_stats(struct sched_t *s, int *jitter_us, int *jitter_max_us, int *late_us, int *skipped);
+
+#endif
@@ -1,16 +1,20 @@
 /**
- * This is an audio visualisation specifically written for a 80x8 pixel RGB led banner.
+ * This is an audio visualisation specifically written for a 80x8 pixel RGB led banner, other panel sizes can be
+ * set with -g.
  * It reads raw audio frames from a shared-memory mmap'ed file and writes raw RGB frames to stdout.
  *
  * Features:
  * - on the right, shows instantenous spectral energy
  * - on the left, shows historic spectral energy, scrolling left
- * - each horizontal line represents one octave, from about 43 Hz to 11025 Hz (at 44.1 kHz sample rate)
+ * - each horizontal line represents one octave, from about 43 Hz to 11025 Hz (at 44.1 kHz sample rate),
+ *   or an equal part of those 8 octaves on panels that are not 8 pixels high
  * - the spectrum amplitude automatically adjusts to input level, by scaling to an averaged RMS value
  *
  * Details:
- * - Every time a new block of 1024 stereo samples is available, a block of 2048 samples is prepared for FFT.
- * - The block of 2048 samples consists of 1024 previous audio samples and 1024 new audio samples, converted to mono.
+ * - The audio is converted to mono and fed to a streaming STFT: a window of the newest n samples (-n, default 2048)
+ *   that advances by a hop of new samples at a time (-s, default 882, 20 ms at 44.1 kHz).
+ * - Every hop adds one column to the history; the banner is redrawn at a fixed frame rate (-r, default 50 fps),
+ *   showing however many columns were added since the last frame.
  * - A triangular windowing function is applied before converting to spectral data using a discrete fourier transform.
  * - The spectral distribution is converted to an energy per octave, by simply summing the total energy in each octave.
  * - An RMS value per octave is calculated by taking the square root of the energy, and scaling it to the average RMS.
@@ -19,71 +23,37 @@
  * - For the spectrogram, the display value is mapped on a palette going from black-blue-green-yellow-red.
  **/
 
-#include <string.h>     // memset
+#include <string.h>     // memset, memcpy
 #include <stdio.h>      // perror, fprintf
 #include <stdlib.h>     // exit
-#include <unistd.h>     // write, usleep
-#include <sys/mman.h>   // MAP_FAILED
-#include <fcntl.h>      // open
 #include <math.h>       // log, sqrt, etc.
-#include <sys/time.h>
 #include "fftw3.h"
 
 #include "squeeze_vis.h"
+#include "mono.h"
+#include "ring.h"
+#include "ingest.h"
+#include "dsp.h"
+#include "real.h"
+#include "analysis.h"
+#include "cache.h"
+#include "stft.h"
+#include "mra.h"
+#include "bank.h"
+#include "args.h"
+#include "output.h"
+#include "sched.h"
+#include "offline.h"
+#include "prof.h"
+#include "metrics.h"
+#include "geometry.h"
+#include "pool.h"
 
 // led banner definitions
-#define WIDTH 80
-#define HEIGHT 8
-#define BARS_SIZE   16
 #define NR_COLORS   240
 
-#define FFT_N       2048
-#define AUDIO_FRAME (FFT_N)
-
-#define CLAMP(x,min,max) ((x)<(min)?(min):(x)>(max)?(max):(x))
-
-static uint64_t utime() {
-    static struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1e6 + tv.tv_usec;
-}
-
-
-// mmap the file
-static bool do_mmap(const char *filename)
-{
-    int vis_fd;
-
-    vis_fd = open(filename, O_RDONLY, 0);
-    if (vis_fd <= 0) {
-        perror("open failed");
-        return false;
-    }
-
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ, MAP_SHARED, vis_fd, 0);
-	if (vis_mmap == MAP_FAILED) {
-        perror("mmap failed");
-        return false;
-	}
-
-	return true;
-}
-
-// fixes an offset x in the visualisation buffer to the range 0..VIS_BUF_SIZE-1
-static int fix_offset(int offset)
-{
-    offset = (offset + VIS_BUF_SIZE) % VIS_BUF_SIZE;
-    if (offset < 0) {
-        offset += VIS_BUF_SIZE;
-    }
-    return offset;
-}
-
-// outputs a frame to stdout
-static void output(uint8_t frame[HEIGHT][WIDTH][3], int size)
-{
-    write(1, frame, size);
-}
+// width of the spectrum bars on the right, 16 on the 80 pixel banner
+#define BARS_SIZE(width)    ((width) / 5)
 
 // creates a palette ranging from black, blue, green, yellow, red, white
 static void create_palet(uint8_t palet[][3])
@@ -114,57 +84,58 @@ static void create_palet(uint8_t palet[][3])
     }
 }
 
-// draws spectrogram + spectrum bars, returns current rms value
-static double draw_spect(uint8_t frame[HEIGHT][WIDTH][3], uint8_t palet[][3], fftw_plan plan, fftw_complex out[], double scale)
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+// columns of spectrogram history kept, a power of two, at least the widest panel
+#define HISTORY_SIZE    GEOMETRY_MAX_WIDTH
+
+// spectrogram history, the display level of each octave for the last HISTORY_SIZE columns, as a ring of columns
+// with the newest at head - 1, and the same columns coloured with the palette; each octave is kept as a row, so a
+// frame is drawn by copying one or two runs per row instead of scrolling its pixels, and the coloured history
+// can be rebuilt from the levels with another palette
+struct history_t {
+    uint8_t level[GEOMETRY_MAX_HEIGHT][HISTORY_SIZE];
+    uint8_t rgb[GEOMETRY_MAX_HEIGHT][HISTORY_SIZE][3];
+    int head;
+    int columns;        // columns added so far, up to HISTORY_SIZE
+};
+
+static struct history_t history;
+
+// a frame being drawn, shared by the threads drawing its rows
+struct draw_t {
+    int width;
+    int height;
+    uint8_t *frame;
+    const uint8_t (*palet)[3];
+    const struct history_t *history;
+};
+
+// draws the spectrogram history and the spectrum bars of the newest column in rows start..end-1
+GEOMETRY_INLINE void draw_rows(int width, int height, uint8_t frame[height][width][3], const uint8_t palet[][3],
+                               const struct history_t *hist, int start, int end)
 {
-    // forward fft
-    fftw_execute(plan);
-
-    // scroll spectrogram left
+    const int bars = BARS_SIZE(width);
+    const int shown = MIN(hist->columns, width - bars);
+    const int blank = width - bars - shown;
+    // the shown columns are at most two runs in the ring, up to its end and from its start
+    const int oldest = (hist->head - shown) & (HISTORY_SIZE - 1);
+    const int run = MIN(shown, HISTORY_SIZE - oldest);
     int x;
-    int y;
-    for (y = 0; y < HEIGHT; y++) {
-        for (x = 1; x < WIDTH - BARS_SIZE; x++) {
-            frame[y][x - 1][0] = frame[y][x][0];
-            frame[y][x - 1][1] = frame[y][x][1];
-            frame[y][x - 1][2] = frame[y][x][2];
-        }
-    }
-
-    // draw new spectrogram column
-    int i;
-    int size = FFT_N / 1024;
-    int index = size;
-    double totalsum = 0.0;
-    for (y = 0; y < HEIGHT; y++) {
-        // sum all energy in one octave
-        double sum = 0.0;
-        for (i = 0; i < size; i++) {
-            // re^2
-            sum += out[index][0] * out[index][0];
-            // im^2
-            sum += out[index][1] * out[index][1];
-            index++;
-        }
-        size *= 2;
-        totalsum += sum;
-
-        // compute palette index
-        int h = 50.0 * sqrt(sqrt(sum) / scale);
-        h = CLAMP(h, 0, NR_COLORS - 1);
+    int yy;
+    for (yy = start; yy < end; yy++) {
+        const int y = height - 1 - yy;
 
-        // spectrogram pixels
-        int xx = WIDTH - BARS_SIZE - 1;
-        int yy = 7 - y;
-        frame[yy][xx][0] = palet[h][0];
-        frame[yy][xx][1] = palet[h][1];
-        frame[yy][xx][2] = palet[h][2];
+        // spectrogram pixels, black where there is no history yet, the newest column last
+        memset(frame[yy], 0, sizeof(frame[yy][0]) * blank);
+        memcpy(frame[yy][blank], hist->rgb[y][oldest], sizeof(frame[yy][0]) * run);
+        memcpy(frame[yy][blank + run], hist->rgb[y][0], sizeof(frame[yy][0]) * (shown - run));
 
         // spectrum bars
-        int x;
-        for (x = 0; x < BARS_SIZE; x++) {
-            int xx = x + WIDTH - BARS_SIZE;
-            int cc = x * NR_COLORS / BARS_SIZE;
+        int h = hist->level[y][(hist->head - 1) & (HISTORY_SIZE - 1)];
+        for (x = 0; x < bars; x++) {
+            int xx = x + width - bars;
+            int cc = x * NR_COLORS / bars;
             if (cc <= h) {
                 frame[yy][xx][0] = palet[cc][0];
                 frame[yy][xx][1] = palet[cc][1];
@@ -176,99 +147,261 @@ static double draw_spect(uint8_t frame[HEIGHT][WIDTH][3], uint8_t palet[][3], ff
             }
         }
     }
+}
+
+static void draw_job(void *ctx, int start, int end)
+{
+    struct draw_t *d = ctx;
+    GEOMETRY_CALL(d->width, d->height, draw_rows, (void *)d->frame, d->palet, d->history, start, end);
+}
+
+// draws the spectrogram history and spectrum bars into the frame
+static void draw_spect(int width, int height, uint8_t *frame, const uint8_t palet[][3])
+{
+    static struct draw_t d;
+
+    // draw, split in rows over the threads
+    d.width = width;
+    d.height = height;
+    d.frame = frame;
+    d.palet = palet;
+    d.history = &history;
+    pool_run(draw_job, &d, height);
+}
+
+// adds a column with the level of each octave to the history, from the power in each octave, returns current
+// rms value
+static real_t add_column(int height, const uint8_t palet[][3], const struct analysis_t *a, const real_t power[],
+                         real_t totalsum, real_t scale)
+{
+    real_t norm = 1.0 / (scale * scale);
+
+    // palette index and colour of each octave
+    int y;
+    for (y = 0; y < height; y++) {
+        int h = analysis_level(a, power[y] * norm);
+        history.level[y][history.head] = h;
+        history.rgb[y][history.head][0] = palet[h][0];
+        history.rgb[y][history.head][1] = palet[h][1];
+        history.rgb[y][history.head][2] = palet[h][2];
+    }
+    history.head = (history.head + 1) & (HISTORY_SIZE - 1);
+    if (history.columns < HISTORY_SIZE) {
+        history.columns++;
+    }
 
     // return total energy in spectrogram
-    return sqrt(totalsum / index);
+    return REAL(sqrt)(totalsum / a->end);
 }
 
-static uint8_t banner[HEIGHT][WIDTH][3];
+static uint8_t banner[GEOMETRY_MAX_PIXELS][3];
+
+// startup state, kept in the startup cache between runs
+struct startup_t {
+    struct analysis_t analysis;
+    uint8_t palette[NR_COLORS][3];
+};
+
+#define STARTUP_VERSION 1
+
+// maps the startup state from the cache, or builds it and stores it in the cache
+static const struct startup_t *load_startup(int fft_n, int width, int height, const char **source)
+{
+    const int params[] = { STARTUP_VERSION, fft_n, width, height, NR_COLORS };
+    uint32_t key = cache_key(params, sizeof(params) / sizeof(params[0]));
+    const struct startup_t *cached = cache_map("spectrogram", key, sizeof(struct startup_t));
+    if (cached != NULL) {
+        *source = "cached";
+        return cached;
+    }
+
+    static struct startup_t fresh;
+    create_palet(fresh.palette);
+    // analysis plan, one octave per row
+    analysis_window(&fresh.analysis, fft_n);
+    analysis_octaves(&fresh.analysis, height);
+    analysis_levels(&fresh.analysis, NR_COLORS, 50.0);
 
-// argv[1] = name of /dev/shm file created by squeezelite
-// argv[2] = number of seconds to run (if not present: forever)
+    *source = cache_store("spectrogram", key, &fresh, sizeof(fresh)) ? "built" : "built, not saved";
+    return &fresh;
+}
+
+// usage: spectrogram [-n fft size] [-s hop size] [-a engine] [-r fps] [-e encoding] [-f format] [-d dither] [-o file]
+//                    [-i wav file] [-g geometry] [-j threads] [shm file] [seconds]
+// shm file = name of /dev/shm file created by squeezelite
+// seconds = number of seconds to run (if not present: forever)
 int main(int argc, char *argv[])
 {
-    // mmap file
-    const char *filename = "/dev/shm/squeezelite-00:21:00:02:cc:45";
-    if (argc > 1) {
-        filename = argv[1];
+    int64_t t_start = mono_ns();
+
+    struct args_t args = {
+        .options = "n:s:a:r:e:f:d:o:i:g:j:",
+        .filename = "/dev/shm/squeezelite-00:21:00:02:cc:45",
+        .runtime = 0,
+        .fft_n = 2048,
+        .hop = 882,
+        .fps = 50,
+    };
+    args_parse(&args, argc, argv);
+    if (args.hop == 0) {
+        args.hop = args.fft_n / 2;
+    }
+
+    // mmap file, or play a WAV file into a private buffer
+    if ((args.input != NULL) ? !offline_open(args.input) : !vis_open(args.filename, false)) {
+        exit(-1);
     }
-    if (!do_mmap(filename)) {
+    if (!output_init(args.encoding, args.format, args.dither, args.width, args.height, args.output)) {
         exit(-1);
     }
+    if (!pool_init(args.threads, args.width * args.height)) {
+        exit(-1);
+    }
+    if (offline) {
+        output_blocking();
+    }
 
     // max runtime
     int seconds = 0;
-    int runtime = 0;
-    if (argc > 2) {
-        runtime = atoi(argv[2]);
-    }
+    int runtime = args.runtime;
 
     time_t now;
     time_t then = time(NULL);
     int fps = 0;
 
-    // palette
-    uint8_t palette[NR_COLORS][3];
-    create_palet(palette);
-
-    // fft initialisation
-    double *in;
-    fftw_complex *out;
-    fftw_plan plan;
-    in = (double*) fftw_malloc(sizeof(double) * FFT_N);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (FFT_N / 2 + 1));
-    plan = fftw_plan_dft_r2c_1d(FFT_N, in, out, 0);
+    if (!stft_check(args.fft_n, args.hop)) {
+        fprintf(stderr, "invalid fft size %d (%d..%d) or hop size %d\n", args.fft_n, STFT_MIN_N, STFT_MAX_N, args.hop);
+        exit(-1);
+    }
+
+    // palette and analysis plan
+    const char *tables;
+    const struct startup_t *startup = load_startup(args.fft_n, args.width, args.height, &tables);
+
+    // streaming fft
+    struct stft_t stft;
+    if (!stft_init(&stft, args.fft_n, args.hop, startup->analysis.window)) {
+        fprintf(stderr, "stft_init failed\n");
+        exit(-1);
+    }
+    // or the stages of the multi-resolution analysis, following the audio the stft takes
+    static struct mra_t mra;
+    if ((args.engine == ENGINE_MRA) && !mra_init(&mra, &startup->analysis)) {
+        fprintf(stderr, "mra_init failed\n");
+        exit(-1);
+    }
+    // or the octave filterbank
+    static struct bank_t bank;
+    if ((args.engine == ENGINE_IIR) && !bank_init(&bank, &startup->analysis)) {
+        fprintf(stderr, "bank_init failed\n");
+        exit(-1);
+    }
+    cache_wisdom_save();
     int rms_avg = 1;
 
-    u32_t buf_index = 0;
+    int64_t t_init = mono_ns();
+    bool first_frame = true;
+
+    struct ingest_t ingest;
+    ingest_init(&ingest, 100000);
+
+    struct sched_t sched;
+    sched_init(&sched, args.fps);
+
+    struct metrics_t *metrics = offline ? NULL : metrics_open(argv[0]);
 
-    static uint64_t start;
-    start = utime();
     while (vis_mmap->running) {
-        // check for data available
-        int avail = fix_offset(vis_mmap->buf_index - buf_index);
-        bool have_new_data = (avail >= AUDIO_FRAME);
-        if (have_new_data) {
-            // unwrap buffer, convert stereo integer to mono double, apply simple triangular window
-            int i;
-            for (i = 0; i < (2 * AUDIO_FRAME); i += 2) {
-                int index = fix_offset(buf_index - AUDIO_FRAME + i);
-                double w = (i < AUDIO_FRAME) ? i : (2*AUDIO_FRAME - i);
-                in[i / 2] = w * (vis_mmap->buffer[index + 0] + vis_mmap->buffer[index + 1]);
+        // wait until the next frame is due
+        prof_start();
+        sched_wait(&sched, &ingest, stft.read_index, 2 * stft.hop);
+        prof_lap(PROF_WAIT);
+
+        // add a spectrogram column for each new hop of audio
+        bool have_new_data = false;
+        while (stft_feed(&stft, 1) > 0) {
+            prof_lap(PROF_INGEST);
+            // sum all energy in each octave
+            real_t power[GEOMETRY_MAX_HEIGHT];
+            real_t totalsum;
+            if (args.engine == ENGINE_MRA) {
+                mra_follow(&mra, &stft);
+                totalsum = mra_power(&mra, power);
+                prof_lap(PROF_ANALYSE);
+            } else if (args.engine == ENGINE_IIR) {
+                bank_follow(&bank, &stft);
+                totalsum = bank_power(&bank, power);
+                prof_lap(PROF_ANALYSE);
+            } else {
+                stft_analyse(&stft);
+                prof_lap(PROF_ANALYSE);
+                totalsum = analysis_power(&startup->analysis, stft.out, power);
             }
-            // update our read index
-            buf_index = fix_offset(buf_index + AUDIO_FRAME);
+            prof_lap(PROF_MAP);
+            real_t rms = add_column(args.height, startup->palette, &startup->analysis, power, totalsum, rms_avg);
+            prof_lap(PROF_RENDER);
+            rms_avg += (rms - rms_avg) / 64;
+            have_new_data = true;
         }
+        // the last feed, which found no complete hop
+        prof_lap(PROF_INGEST);
 
         // update led banner
-	uint64_t duration = utime() - start;
-	const float interval = 20000;
-	if (duration >= interval) {
-	    start = utime();
-
-            double rms = draw_spect(banner, palette, plan, out, rms_avg);
-            rms_avg += (rms - rms_avg) / 64;
-            output(banner, sizeof(banner));
+        if (have_new_data) {
+            draw_spect(args.width, args.height, &banner[0][0], startup->palette);
+            prof_lap(PROF_RENDER);
+            output_frame(&banner[0][0], ingest_written(&ingest, stft.read_index));
+            prof_lap(PROF_OUTPUT);
+            sched_frame(&sched);
+            if (first_frame) {
+                cache_report_startup(t_init - t_start, mono_ns() - t_start, tables);
+                first_frame = false;
+            }
             fps++;
+        } else {
+            // send what is still waiting for the reader
+            output_flush();
         }
 
         // stats
         now = time(NULL);
         if (now != then) {
-            // fprintf(stderr, "fps=%d, rms=%6d\n", fps, rms_avg);
+            int wakeups, early, saved;
+            ingest_stats(&ingest, &wakeups, &early, &saved);
+            int jitter, jitter_max, late, skipped;
+            sched_stats(&sched, &jitter, &jitter_max, &late, &skipped);
+            int bytes, keyframes, dropped, partial;
+            output_stats(&bytes, &keyframes, &dropped, &partial);
+            fprintf(stderr, "fps=%d, rms=%6d, wakeups=%d, early=%d, saved=%d, torn=%d, retries=%d, resyncs=%d, "
+                    "jitter=%d/%dus, late=%dus, skipped=%d, out=%dB/s, keyframes=%d, "
+                    "dropped=%d, partial=%d\n",
+                    fps, rms_avg, wakeups, early, saved, ring_stats.torn, ring_stats.retries, stft.resyncs,
+                    jitter, jitter_max, late, skipped, bytes, keyframes,
+                    dropped, partial);
+            prof_dump(stderr);
             then = now;
             fps = 0;
             seconds++;
         }
 
+        metrics_publish(metrics, sched.total, output_dropped(), rms_avg);
+
         // check max runtime
         if ((runtime > 0) && (seconds > runtime)) {
             break;
         }
-
-	usleep(100);
     }
 
+    if (offline) {
+        offline_report(sched.total);
+    }
+    if (args.engine == ENGINE_MRA) {
+        mra_free(&mra);
+    }
+    if (args.engine == ENGINE_IIR) {
+        bank_free(&bank);
+    }
+    metrics_close(metrics);
+    output_close();
     return 0;
 }
 
@@ -1,5 +1,6 @@
 /**
- * This is an audio visualisation specifically written for a 80x8 pixel RGB led banner.
+ * This is an audio visualisation specifically written for a 80x8 pixel RGB led banner, other panel sizes can be
+ * set with -g.
  * It reads raw audio frames from a shared-memory mmap'ed file and writes raw RGB frames to stdout.
  *
  * Features:
@@ -10,62 +11,35 @@
 #include <string.h>     // memset
 #include <stdio.h>      // perror, fprintf
 #include <stdlib.h>     // exit
-#include <unistd.h>     // write, usleep
-#include <sys/mman.h>   // MAP_FAILED
-#include <fcntl.h>      // open
 #include <math.h>       // log, sqrt, etc.
+#include <limits.h>     // INT_MAX
 
 #include "fftw3.h"
 
 #include "squeeze_vis.h"
+#include "ring.h"
+#include "ingest.h"
+#include "dsp.h"
+#include "real.h"
+#include "analysis.h"
+#include "cache.h"
+#include "mono.h"
+#include "stft.h"
+#include "mra.h"
+#include "args.h"
+#include "output.h"
+#include "sched.h"
+#include "offline.h"
+#include "prof.h"
+#include "metrics.h"
+#include "geometry.h"
+#include "pool.h"
 
 // led banner definitions
-#define WIDTH 80
-#define HEIGHT 8
-#define BARS_SIZE   16
 #define NR_COLORS   180
 
-#define FFT_N       2048
-#define AUDIO_FRAME (FFT_N)
-
 #define CLAMP(x,min,max) ((x)<(min)?(min):(x)>(max)?(max):(x))
 
-// mmap the file
-static bool do_mmap(const char *filename)
-{
-    int vis_fd;
-
-    vis_fd = open(filename, O_RDONLY, 0);
-    if (vis_fd <= 0) {
-        perror("open failed");
-        return false;
-    }
-
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ, MAP_SHARED, vis_fd, 0);
-	if (vis_mmap == MAP_FAILED) {
-        perror("mmap failed");
-        return false;
-	}
-
-	return true;
-}
-
-// fixes an offset x in the visualisation buffer to the range 0..VIS_BUF_SIZE-1
-static int fix_offset(int offset)
-{
-    offset = (offset + VIS_BUF_SIZE) % VIS_BUF_SIZE;
-    if (offset < 0) {
-        offset += VIS_BUF_SIZE;
-    }
-    return offset;
-}
-
-// outputs a frame to stdout
-static void output(uint8_t frame[HEIGHT][WIDTH][3], int size)
-{
-    write(1, frame, size);
-}
-
 // creates a palette ranging from black, blue, green, yellow, red, white
 static void create_palet(uint8_t palet[][3])
 {
@@ -89,23 +63,63 @@ static void create_palet(uint8_t palet[][3])
     }
 }
 
-// draws spectrogram + spectrum bars, returns current rms value
-static double draw_spect(uint8_t frame[HEIGHT][WIDTH][3], uint8_t palet[][3], fftw_plan plan, fftw_complex out[], double scale)
+// a frame being drawn, shared by the threads drawing its rows
+struct draw_t {
+    int width;
+    int height;
+    uint8_t *frame;
+    const uint8_t (*palet)[3];
+    int level[GEOMETRY_MAX_WIDTH];      // display level of each column
+};
+
+// draws the spectrum bars in rows start..end-1
+GEOMETRY_INLINE void draw_rows(int width, int height, uint8_t frame[height][width][3], const uint8_t palet[][3],
+                               const int level[], int start, int end)
+{
+    int x, yy;
+    for (yy = start; yy < end; yy++) {
+        int y = height - 1 - yy;
+        for (x = 0; x < width; x++) {
+#if 1
+            int cc = (y * (NR_COLORS - 1) / (height - 1));
+#else
+            int cc = (level[x] * (NR_COLORS - 1) / (height - 1));
+#endif
+            cc = CLAMP(cc, 0, NR_COLORS - 1);
+            if (y < level[x]) {
+                frame[yy][x][0] = palet[cc][0];
+                frame[yy][x][1] = palet[cc][1];
+                frame[yy][x][2] = palet[cc][2];
+            }
+        }
+    }
+}
+
+static void draw_job(void *ctx, int start, int end)
 {
-    int x, y;
+    struct draw_t *d = ctx;
+    GEOMETRY_CALL(d->width, d->height, draw_rows, (void *)d->frame, d->palet, d->level, start, end);
+}
+
+// draws the spectrum bars from the power in each column, returns current rms value
+GEOMETRY_INLINE real_t draw_spect(int width, int height, uint8_t frame[height][width][3], const uint8_t palet[][3],
+                                  const struct analysis_t *a, const real_t power[], real_t totalsum, real_t scale)
+{
+    int x;
 #if 1
-    memset(frame, 0, HEIGHT*WIDTH*3);
+    memset(frame, 0, height*width*3);
 #else // scrolling pseudo-3d
+    int y;
     static int t = 0;
     t = (t + 1) % 3;
     if (t == 0) {
-        for (y = 0; y < HEIGHT; y++) {
-            for (x = 0; x < WIDTH; x++) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
                 int sx, sy;
                 sx = x - 1;
                 sy = y + 1;
                 int r,g,b;
-                if ((sx >= 0) && (sx < WIDTH) && (sy >= 0) && (sy < HEIGHT)) {
+                if ((sx >= 0) && (sx < width) && (sy >= 0) && (sy < height)) {
                     r = 0.75 * frame[sy][sx][0];
                     g = 0.75 * frame[sy][sx][1];
                     b = 0.75 * frame[sy][sx][2];
@@ -122,139 +136,227 @@ static double draw_spect(uint8_t frame[HEIGHT][WIDTH][3], uint8_t palet[][3], ff
     }
 #endif
 
-    // forward fft
-    fftw_execute(plan);
-
-    // draw new spectrogram column
-    int i;
-    int index = 2;  // first bin starts at 43 Hz
-    double totalsum = 0.0;
-    for (x = 0; x < WIDTH; x++) {
-        // calculate bin size
-        int size = pow(2.0, x / 8.0) / 20.0;
-        if (size < 1) {
-            size = 1;
-        }
-        
-        // sum all energy in bin
-        double sum = 0.0;
-        for (i = 0; i < size; i++) {
-            // re^2
-            sum += out[index][0] * out[index][0];
-            // im^2
-            sum += out[index][1] * out[index][1];
-            index++;
-        }
-        totalsum += sum;
-
-        // compute palette index
-        int h = 3.0 * sqrt(sqrt(sum) / scale);
+    real_t norm = 1.0 / (scale * scale);
 
-        // spectrum bars
-        for (y = 0; y < HEIGHT; y++) {
-            int xx = x;
-            int yy = HEIGHT - 1 - y;
-#if 1
-            int cc = (y * (NR_COLORS - 1) / (HEIGHT - 1));
-#else
-            int cc = (h * (NR_COLORS - 1) / (HEIGHT - 1));
-#endif
-            cc = CLAMP(cc, 0, NR_COLORS - 1);
-            if (y < h) {
-                frame[yy][xx][0] = palet[cc][0];
-                frame[yy][xx][1] = palet[cc][1];
-                frame[yy][xx][2] = palet[cc][2];
-            }
-        }
+    // compute palette index of each column
+    static struct draw_t d;
+    for (x = 0; x < width; x++) {
+        d.level[x] = analysis_level(a, power[x] * norm);
     }
-    
+
+    // spectrum bars, split in rows over the threads
+    d.width = width;
+    d.height = height;
+    d.frame = &frame[0][0][0];
+    d.palet = palet;
+    pool_run(draw_job, &d, height);
+
     // return total energy in spectrogram
-    return sqrt(totalsum / index);
+    return REAL(sqrt)(totalsum / a->end);
 }
 
-static uint8_t banner[HEIGHT][WIDTH][3];
+static uint8_t banner[GEOMETRY_MAX_PIXELS][3];
+
+// startup state, kept in the startup cache between runs
+struct startup_t {
+    struct analysis_t analysis;
+    uint8_t palette[NR_COLORS][3];
+};
+
+#define STARTUP_VERSION 1
+
+// maps the startup state from the cache, or builds it and stores it in the cache
+static const struct startup_t *load_startup(int fft_n, int width, int height, const char **source)
+{
+    const int params[] = { STARTUP_VERSION, fft_n, width, height, NR_COLORS };
+    uint32_t key = cache_key(params, sizeof(params) / sizeof(params[0]));
+    const struct startup_t *cached = cache_map("spectrum", key, sizeof(struct startup_t));
+    if (cached != NULL) {
+        *source = "cached";
+        return cached;
+    }
+
+    static struct startup_t fresh;
+    create_palet(fresh.palette);
+    // analysis plan, first bin starts at 43 Hz (n/1024 at 44.1 kHz)
+    analysis_window(&fresh.analysis, fft_n);
+    analysis_log_columns(&fresh.analysis, width, fft_n / 1024);
+    analysis_levels(&fresh.analysis, height + 1, 3.0 * height / 8);
+
+    *source = cache_store("spectrum", key, &fresh, sizeof(fresh)) ? "built" : "built, not saved";
+    return &fresh;
+}
 
-// argv[1] = name of /dev/shm file created by squeezelite
-// argv[2] = number of seconds to run (if not present: forever)
+// usage: spectrum [-n fft size] [-s hop size] [-a engine] [-r fps] [-e encoding] [-f format] [-d dither] [-o file]
+//                 [-i wav file] [-g geometry] [-j threads] [shm file] [seconds]
+// shm file = name of /dev/shm file created by squeezelite
+// seconds = number of seconds to run (if not present: forever)
 int main(int argc, char *argv[])
 {
-    // mmap file
-    const char *filename = "/dev/shm/squeezelite-00:21:00:02:cc:45";
-    if (argc > 1) {
-        filename = argv[1];
+    int64_t t_start = mono_ns();
+
+    struct args_t args = {
+        .options = "n:s:a:r:e:f:d:o:i:g:j:",
+        .filename = "/dev/shm/squeezelite-00:21:00:02:cc:45",
+        .runtime = 0,
+        .fft_n = 2048,
+        .hop = 0,
+        .fps = 0,
+    };
+    args_parse(&args, argc, argv);
+    if (args.hop == 0) {
+        args.hop = args.fft_n / 2;
     }
-    if (!do_mmap(filename)) {
+
+    // mmap file, or play a WAV file into a private buffer
+    if ((args.input != NULL) ? !offline_open(args.input) : !vis_open(args.filename, false)) {
+        exit(-1);
+    }
+    if (!output_init(args.encoding, args.format, args.dither, args.width, args.height, args.output)) {
+        exit(-1);
+    }
+    if (!pool_init(args.threads, args.width * args.height)) {
         exit(-1);
     }
+    if (offline) {
+        output_blocking();
+    }
 
     // max runtime
     int seconds = 0;
-    int runtime = 0;
-    if (argc > 2) {
-        runtime = atoi(argv[2]);
-    }
+    int runtime = args.runtime;
 
     time_t now;
     time_t then = time(NULL);
     int fps = 0;
 
-    // palette
-    uint8_t palette[NR_COLORS][3];
-    create_palet(palette);
-
-    // fft initialisation
-    double *in;
-    fftw_complex *out;
-    fftw_plan plan;
-    in = (double*) fftw_malloc(sizeof(double) * FFT_N);
-    out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (FFT_N / 2 + 1));
-    plan = fftw_plan_dft_r2c_1d(FFT_N, in, out, 0);
+    if (args.engine == ENGINE_IIR) {
+        fprintf(stderr, "the iir filterbank only makes octaves, for the spectrogram\n");
+        exit(-1);
+    }
+    if (!stft_check(args.fft_n, args.hop)) {
+        fprintf(stderr, "invalid fft size %d (%d..%d) or hop size %d\n", args.fft_n, STFT_MIN_N, STFT_MAX_N, args.hop);
+        exit(-1);
+    }
+
+    // palette and analysis plan
+    const char *tables;
+    const struct startup_t *startup = load_startup(args.fft_n, args.width, args.height, &tables);
+
+    // streaming fft
+    struct stft_t stft;
+    if (!stft_init(&stft, args.fft_n, args.hop, startup->analysis.window)) {
+        fprintf(stderr, "stft_init failed\n");
+        exit(-1);
+    }
+    // or the stages of the multi-resolution analysis, following the audio the stft takes
+    static struct mra_t mra;
+    if ((args.engine == ENGINE_MRA) && !mra_init(&mra, &startup->analysis)) {
+        fprintf(stderr, "mra_init failed\n");
+        exit(-1);
+    }
+    cache_wisdom_save();
     int rms_avg = 1;
 
-    u32_t buf_index = 0;
+    int64_t t_init = mono_ns();
+    bool first_frame = true;
+
+    struct ingest_t ingest;
+    ingest_init(&ingest, 1000000);
+
+    struct sched_t sched;
+    sched_init(&sched, args.fps);
+
+    struct metrics_t *metrics = offline ? NULL : metrics_open(argv[0]);
 
     while (vis_mmap->running) {
-        // check for data available
-        int avail = fix_offset(vis_mmap->buf_index - buf_index);
-        bool have_new_data = (avail >= AUDIO_FRAME);
-        if (have_new_data) {
-            // unwrap buffer, convert stereo integer to mono double, apply simple triangular window
-            int i;
-            for (i = 0; i < (2 * AUDIO_FRAME); i += 2) {
-                int index = fix_offset(buf_index - AUDIO_FRAME + i);
-                double w = (i < AUDIO_FRAME) ? i : (2*AUDIO_FRAME - i);
-                in[i / 2] = w * (vis_mmap->buffer[index + 0] + vis_mmap->buffer[index + 1]);
+        // wait until the next frame is due
+        prof_start();
+        sched_wait(&sched, &ingest, stft.read_index, 2 * stft.hop);
+        prof_lap(PROF_WAIT);
+
+        // take all new audio, only the newest analysis frame is shown
+        bool have_new_data;
+        if (args.engine == ENGINE_MRA) {
+            // the stages need every hop
+            have_new_data = false;
+            while (stft_feed(&stft, 1) > 0) {
+                mra_follow(&mra, &stft);
+                have_new_data = true;
             }
-            // update our read index
-            buf_index = fix_offset(buf_index + AUDIO_FRAME);
+        } else {
+            have_new_data = (stft_feed(&stft, INT_MAX) > 0);
         }
+        prof_lap(PROF_INGEST);
 
         // update led banner
         if (have_new_data) {
-            double rms = draw_spect(banner, palette, plan, out, rms_avg);
+            // sum all energy in each column
+            real_t power[GEOMETRY_MAX_WIDTH];
+            real_t totalsum;
+            if (args.engine == ENGINE_MRA) {
+                totalsum = mra_power(&mra, power);
+                prof_lap(PROF_ANALYSE);
+            } else {
+                stft_analyse(&stft);
+                prof_lap(PROF_ANALYSE);
+                totalsum = analysis_power(&startup->analysis, stft.out, power);
+            }
+            prof_lap(PROF_MAP);
+            real_t rms = GEOMETRY_CALL(args.width, args.height, draw_spect, (void *)banner, startup->palette,
+                                       &startup->analysis, power, totalsum, rms_avg);
+            prof_lap(PROF_RENDER);
             rms_avg += (rms - rms_avg) / 64;
-            output(banner, sizeof(banner));
+            output_frame(&banner[0][0], ingest_written(&ingest, stft.read_index));
+            prof_lap(PROF_OUTPUT);
+            sched_frame(&sched);
+            if (first_frame) {
+                cache_report_startup(t_init - t_start, mono_ns() - t_start, tables);
+                first_frame = false;
+            }
             fps++;
+        } else {
+            // send what is still waiting for the reader
+            output_flush();
         }
 
         // stats
         now = time(NULL);
         if (now != then) {
-            fprintf(stderr, "fps=%d, rms=%6d\n", fps, rms_avg);
+            int wakeups, early, saved;
+            ingest_stats(&ingest, &wakeups, &early, &saved);
+            int jitter, jitter_max, late, skipped;
+            sched_stats(&sched, &jitter, &jitter_max, &late, &skipped);
+            int bytes, keyframes, dropped, partial;
+            output_stats(&bytes, &keyframes, &dropped, &partial);
+            fprintf(stderr, "fps=%d, rms=%6d, wakeups=%d, early=%d, saved=%d, torn=%d, retries=%d, resyncs=%d, "
+                    "jitter=%d/%dus, late=%dus, skipped=%d, out=%dB/s, keyframes=%d, "
+                    "dropped=%d, partial=%d\n",
+                    fps, rms_avg, wakeups, early, saved, ring_stats.torn, ring_stats.retries, stft.resyncs,
+                    jitter, jitter_max, late, skipped, bytes, keyframes,
+                    dropped, partial);
+            prof_dump(stderr);
             then = now;
             fps = 0;
             seconds++;
         }
 
+        metrics_publish(metrics, sched.total, output_dropped(), rms_avg);
+
         // check max runtime
         if ((runtime > 0) && (seconds > runtime)) {
             break;
         }
-
-        // wait some time
-        usleep(1000);
     }
 
+    if (offline) {
+        offline_report(sched.total);
+    }
+    if (args.engine == ENGINE_MRA) {
+        mra_free(&mra);
+    }
+    metrics_close(metrics);
+    output_close();
     return 0;
 }
 
@@ -1,3 +1,6 @@
+#ifndef SQUEEZE_VIS_H
+#define SQUEEZE_VIS_H
+
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -11,7 +14,7 @@ typedef int16_t s16_t;
 #define VIS_BUF_SIZE 16384
 #define VIS_LOCK_NS  1000000 // ns to wait for vis wrlock
 
-static struct vis_t {
+struct vis_t {
 	pthread_rwlock_t rwlock;
 	u32_t buf_size;
 	u32_t buf_index;
@@ -19,5 +22,9 @@ static struct vis_t {
 	u32_t rate;
 	time_t updated;
 	s16_t buffer[VIS_BUF_SIZE];
-} *vis_mmap = NULL;
+};
+
+// the mmap'ed squeezelite visualisation buffer
+extern struct vis_t *vis_mmap;
 
+#endif
@@ -0,0 +1,130 @@
+#include <stdlib.h>     // malloc
+#include <string.h>     // memset
+
+#include "fftw3.h"
+
+#include "squeeze_vis.h"
+#include "ring.h"
+#include "dsp.h"
+#include "cache.h"
+#include "stft.h"
+
+#define MIN(x,y) ((x)<(y)?(x):(y))
+
+// returns whether n and hop are a usable fft size and hop size
+bool stft_check(int n, int hop)
+{
+    return (n >= STFT_MIN_N) && (n <= STFT_MAX_N) && (hop >= 1) && (hop <= n);
+}
+
+// allocates the history and creates the fft plan for an fft of size n, advancing by hop samples per frame
+bool stft_init(struct stft_t *s, int n, int hop, const real_t *window)
+{
+    if (!stft_check(n, hop)) {
+        return false;
+    }
+    s->n = n;
+    s->hop = hop;
+    s->window = window;
+    s->pos = 0;
+    s->read_index = 0;
+    s->synced = false;
+    s->hops = 0;
+    s->resyncs = 0;
+
+    s->history = (real_t*) malloc(sizeof(real_t) * n);
+    s->pcm = (s16_t*) malloc(sizeof(s16_t) * 2 * n);
+    s->in = (real_t*) FFTW(malloc)(sizeof(real_t) * n);
+    s->out = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * (n / 2 + 1));
+    if (!s->history || !s->pcm || !s->in || !s->out) {
+        return false;
+    }
+    s->plan = cache_plan_r2c(n, s->in, s->out);
+    if (!s->plan) {
+        return false;
+    }
+    memset(s->history, 0, sizeof(real_t) * n);
+    memset(s->in, 0, sizeof(real_t) * n);
+    return true;
+}
+
+// converts m interleaved stereo samples to mono and appends them to the history
+static void append(struct stft_t *s, const s16_t *src, int m)
+{
+    while (m > 0) {
+        int len = MIN(m, s->n - s->pos);
+        REAL(dsp_downmix)(src, s->history + s->pos, len);
+        s->pos = (s->pos + len) % s->n;
+        src += 2 * len;
+        m -= len;
+    }
+}
+
+// fills the whole history from the newest audio, returns false if no clean copy could be taken
+static bool resync(struct stft_t *s)
+{
+    u32_t end = vis_mmap->buf_index;
+    if (ring_snapshot(&end, 2 * s->n, 2 * s->n, s->pcm) == 0) {
+        return false;
+    }
+    s->pos = 0;
+    append(s, s->pcm, s->n);
+    s->read_index = ring_fix(end);
+    s->synced = true;
+    s->resyncs++;
+    return true;
+}
+
+// takes up to max_hops hops of new audio from the ring into the history, returns the number taken
+int stft_feed(struct stft_t *s, int max_hops)
+{
+    int hops = 0;
+    while (hops < max_hops) {
+        int avail = ring_avail(s->read_index);
+        if (!s->synced || (avail > STFT_MAX_LAG)) {
+            // start, or skip ahead, from the newest audio, which counts as a new hop
+            if (!resync(s)) {
+                break;
+            }
+            hops++;
+            continue;
+        }
+        if (avail < 2 * s->hop) {
+            break;
+        }
+
+        u32_t end = s->read_index + 2 * s->hop;
+        if (ring_snapshot(&end, 2 * s->hop, 2 * s->hop, s->pcm) == 0) {
+            break;
+        }
+        if (ring_fix(end) != ring_fix(s->read_index + 2 * s->hop)) {
+            // the hop was overwritten and a newer one copied instead, the history is no longer contiguous
+            s->synced = false;
+            continue;
+        }
+        append(s, s->pcm, s->hop);
+        s->read_index = ring_fix(end);
+        hops++;
+    }
+    s->hops += hops;
+    return hops;
+}
+
+// windows the history and transforms it, the spectrum is left in s->out
+void stft_analyse(struct stft_t *s)
+{
+    // the oldest sample is at pos, window the history in two contiguous pieces
+    int tail = s->n - s->pos;
+    REAL(dsp_window)(s->history + s->pos, s->window, s->in, tail);
+    REAL(dsp_window)(s->history, s->window + tail, s->in + tail, s->pos);
+    FFTW(execute)(s->plan);
+}
+
+void stft_free(struct stft_t *s)
+{
+    FFTW(destroy_plan)(s->plan);
+    FFTW(free)(s->in);
+    FFTW(free)(s->out);
+    free(s->history);
+    free(s->pcm);
+}
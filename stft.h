@@ -0,0 +1,51 @@
+/**
+ * Streaming short-time fourier transform over the squeezelite visualisation buffer.
+ *
+ * A history of the last n mono samples is kept between frames. Each step takes the next hop of audio
+ * from the ring, converts only those samples to mono and appends them to the history, so consecutive
+ * analysis frames overlap by n - hop samples and the frame rate follows from the hop size instead of
+ * the fft size.
+ * When the reader falls too far behind the producer, or a hop was overwritten while being copied, the
+ * history is filled again from the newest audio.
+ **/
+
+#ifndef STFT_H
+#define STFT_H
+
+#include <stdbool.h>
+
+#include "squeeze_vis.h"
+#include "real.h"
+
+// fft size limits, the analysis plans start at bin n/1024 and a full history must fit in the ring
+#define STFT_MIN_N      1024
+#define STFT_MAX_N      4096
+// samples the reader may lag behind the producer before it skips ahead to the newest audio
+#define STFT_MAX_LAG    (VIS_BUF_SIZE / 2)
+
+struct stft_t {
+    int n;                  // fft size, in mono samples
+    int hop;                // mono samples between analysis frames
+    const real_t *window;
+    real_t *history;        // the last n mono samples, as a ring starting at pos
+    int pos;
+    s16_t *pcm;             // one hop (or a full history when resyncing) of interleaved stereo samples
+    u32_t read_index;       // ring offset of the next sample to analyse
+    bool synced;
+
+    real_t *in;
+    FFTW(complex) *out;
+    FFTW(plan) plan;
+
+    // statistics
+    int hops;
+    int resyncs;
+};
+
+bool stft_check(int n, int hop);
+bool stft_init(struct stft_t *s, int n, int hop, const real_t *window);
+int stft_feed(struct stft_t *s, int max_hops);
+void stft_analyse(struct stft_t *s);
+void stft_free(struct stft_t *s);
+
+#endif
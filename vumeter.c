@@ -1,98 +1,53 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-
 #include <pthread.h>
 
 #include <stdio.h>
-#include <sys/mman.h>
-
-#include <unistd.h> // write
 
 #include <stdlib.h> // exit
-#include <string.h> // memcpy
+#include <string.h> // memset
 
 #include <math.h>   // sqrt
 
 #include "squeeze_vis.h"
+#include "ring.h"
+#include "ingest.h"
+#include "sched.h"
+#include "offline.h"
+#include "prof.h"
+#include "metrics.h"
+#include "geometry.h"
+#include "pool.h"
+#include "args.h"
+#include "output.h"
+#include "level.h"
 
 // whether to use the pthread lock
 //#define USE_LOCKS
 
-// led banner definitions
-#define WIDTH 80
-#define HEIGHT 8
+// the meter scale, the rms levels were calculated from the squares scaled by 2^8 / 2^16 and divided by the
+// samples of both channels, so they came out sqrt(512) times smaller than the rms
+#define METER_SCALE     sqrt(1.0 / 512)
 
-// mmap the file
-static bool do_mmap(const char *filename)
+// returns the rms values for left and right channel on the meter scale
+static void calc_rms(const struct level_t *level, int *rms_l, int *rms_r)
 {
-    int vis_fd;
-    
-#if USE_LOCKS
-    vis_fd = open(filename, O_RDWR, 0666);
-#else
-    vis_fd = open(filename, O_RDONLY, 0);
-#endif
-    if (vis_fd <= 0) {
-        perror("open failed");
-        return false;
-    }
-
-#if USE_LOCKS
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ | PROT_WRITE, MAP_SHARED, vis_fd, 0);
-#else
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ, MAP_SHARED, vis_fd, 0);
-#endif
-	if (vis_mmap == MAP_FAILED) {
-	    perror("mmap failed");
-	    return false;
-	}
-
-	return true;
-}
-
-// calculates rms values for left and right channel (0..32768)
-static void calc_rms(s16_t *buf, int samples, int *rms_l, int *rms_r)
-{
-    s16_t l,r;
-    int i;
-    int suml = 0;
-    int sumr = 0;
-    for (i = 0; i < samples; i += 2) {
-        l = buf[i];
-        r = buf[i+1];
-        suml += (l * l) >> 16;
-        sumr += (r * r) >> 16;
-    }
-    if (samples > 0) {
-        suml /= samples;
-        sumr /= samples;
-    } else {
-        suml = 0;
-        sumr = 0;
-    }
-    
-    *rms_l = sqrt(suml << 8);
-    *rms_r = sqrt(sumr << 8);
-}
-
-// outputs a frame to stdout
-static void output(uint8_t frame[HEIGHT][WIDTH][3], int size)
-{
-    write(1, frame, size);
+    double l, r;
+    level_rms(level, &l, &r);
+    *rms_l = l * METER_SCALE;
+    *rms_r = r * METER_SCALE;
 }
 
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #define MAX(x,y) ((x)>(y)?(x):(y))
 
-// draws a vu meter pixel
-static void vu_pixel(uint8_t frame[HEIGHT][WIDTH][3], int x, int c)
+// draws the part in rows start..end-1 of a vu meter pixel, c is the position along the bar on a scale of 80 pixels
+GEOMETRY_INLINE void vu_pixel(int width, int height, uint8_t frame[height][width][3], int x, int c, int start,
+                              int end)
 {
     x = MAX(x, 2);
-    x = MIN(x, (WIDTH - 3));
+    x = MIN(x, (width - 3));
 
     int r,g,b;
     if (c < 25) {
@@ -114,19 +69,19 @@ static void vu_pixel(uint8_t frame[HEIGHT][WIDTH][3], int x, int c)
     }
 
     int y;
-    for (y = 2; y < 6; y++) {
+    for (y = MAX(height / 4, start); y < MIN(height - height / 4, end); y++) {
         frame[y][x][0] = r;
         frame[y][x][1] = g;
         frame[y][x][2] = b;
     }
 }
 
-// maps rms value to bitmap size
-static int map(int rms)
+// maps rms value to bitmap size, 8 per pixel on the 80 pixel banner
+static int map(int width, int rms)
 {
-    int v = rms / 8;
-    if (v >= (WIDTH-1)) {
-        v = WIDTH-1;
+    int v = rms * width / 640;
+    if (v >= (width-1)) {
+        v = width-1;
     }
     return v;
 }
@@ -153,68 +108,118 @@ static void calc_peak(struct peak_t *p, int level)
     }
 }
 
-// draw a dual VU
-static void draw_vu(uint8_t frame[HEIGHT][WIDTH][3], int l, int r)
+// a frame being drawn, shared by the threads drawing its rows
+struct draw_t {
+    int width;
+    int height;
+    uint8_t *frame;
+    int il, ir;             // length of the bars
+    int peak_l, peak_r;     // position of the peak indicators
+};
+
+// draws rows start..end-1 of a dual VU
+GEOMETRY_INLINE void draw_rows(int width, int height, uint8_t frame[height][width][3], const struct draw_t *d,
+                               int start, int end)
 {
     int i;
     int x, y;
-    static struct peak_t peak_l;
-    static struct peak_t peak_r;
 
     // blue line around VU
-    memset(frame, 0, WIDTH*HEIGHT*3);
-    for (x = 0; x < WIDTH; x++) {
-        frame[0][x][2] = 0xFF;
-        frame[HEIGHT - 1][x][2] = 0xFF;
-    }
-    for (y = 0; y < HEIGHT; y++) {
+    memset(frame[start], 0, (end - start)*width*3);
+    for (y = start; y < end; y++) {
+        if ((y == 0) || (y == height - 1)) {
+            for (x = 0; x < width; x++) {
+                frame[y][x][2] = 0xFF;
+            }
+        }
         frame[y][0][2] = 0xFF;
-        frame[y][WIDTH - 1][2] = 0xFF;
+        frame[y][width - 1][2] = 0xFF;
     }
 
     // left VU bar
-    int il = map(l);
-    for (i = 0; i < il; i++) {
-        x = (WIDTH - i - 1) / 2;
-        vu_pixel(frame, x, i);
+    for (i = 0; i < d->il; i++) {
+        x = (width - i - 1) / 2;
+        vu_pixel(width, height, frame, x, i * 80 / width, start, end);
     }
     // right VU bar
-    int ir = map(r);
-    for (i = 0; i < ir; i++) {
-        x = (WIDTH + i + 1) / 2;
-        vu_pixel(frame, x, i);
+    for (i = 0; i < d->ir; i++) {
+        x = (width + i + 1) / 2;
+        vu_pixel(width, height, frame, x, i * 80 / width, start, end);
     }
-    
-    // left peak indicator
-    calc_peak(&peak_l, il);
-    vu_pixel(frame, (WIDTH - peak_l.level - 1) / 2, 1000);
 
-    // right peak indicator
-    calc_peak(&peak_r, ir);
-    vu_pixel(frame, (WIDTH + peak_r.level + 1) / 2, 1000);
+    // peak indicators
+    vu_pixel(width, height, frame, (width - d->peak_l - 1) / 2, 1000, start, end);
+    vu_pixel(width, height, frame, (width + d->peak_r + 1) / 2, 1000, start, end);
 }
 
-// argv[1] = name of /dev/shm file created by squeezelite
-// argv[2] = number of seconds to run (if not present: forever)
-int main(int argc, char *argv[])
+static void draw_job(void *ctx, int start, int end)
 {
-    uint8_t banner[HEIGHT][WIDTH][3];
+    struct draw_t *d = ctx;
+    GEOMETRY_CALL(d->width, d->height, draw_rows, (void *)d->frame, d, start, end);
+}
+
+// draw a dual VU
+static void draw_vu(int width, int height, uint8_t *frame, int l, int r)
+{
+    static struct peak_t peak_l;
+    static struct peak_t peak_r;
+    static struct draw_t d;
+
+    // bars and peak indicators
+    d.il = map(width, l);
+    d.ir = map(width, r);
+    calc_peak(&peak_l, d.il);
+    calc_peak(&peak_r, d.ir);
+    d.peak_l = peak_l.level;
+    d.peak_r = peak_r.level;
+
+    // draw, split in rows over the threads
+    d.width = width;
+    d.height = height;
+    d.frame = frame;
+    pool_run(draw_job, &d, height);
+}
+
+static uint8_t banner[GEOMETRY_MAX_PIXELS][3];
 
-    // mmap file
-    const char *filename = "/dev/shm/squeezelite-00:21:00:02:cc:45";
-    if (argc > 1) {
-        filename = argv[1];
+// usage: vumeter [-t integration ms] [-r fps] [-e encoding] [-f format] [-d dither] [-o file] [-i wav file]
+//                [-g geometry] [-j threads] [shm file] [seconds]
+// shm file = name of /dev/shm file created by squeezelite
+// seconds = number of seconds to run (if not present: forever)
+int main(int argc, char *argv[])
+{
+    struct args_t args = {
+        .options = "t:r:e:f:d:o:i:g:j:",
+        .filename = "/dev/shm/squeezelite-00:21:00:02:cc:45",
+        .runtime = 0,
+        .fps = 0,
+        .integration = 100,
+    };
+    args_parse(&args, argc, argv);
+
+    // mmap file, or play a WAV file into a private buffer
+#ifdef USE_LOCKS
+    // taking the rwlock needs a writable mapping
+    bool writable = true;
+#else
+    bool writable = false;
+#endif
+    if ((args.input != NULL) ? !offline_open(args.input) : !vis_open(args.filename, writable)) {
+        exit(-1);
+    }
+    if (!output_init(args.encoding, args.format, args.dither, args.width, args.height, args.output)) {
+        exit(-1);
     }
-    if (!do_mmap(filename)) {
+    if (!pool_init(args.threads, args.width * args.height)) {
         exit(-1);
     }
+    if (offline) {
+        output_blocking();
+    }
     
     // max runtime
     int seconds = 0;
-    int runtime = 0;
-    if (argc > 2) {
-        runtime = atoi(argv[2]);
-    }
+    int runtime = args.runtime;
 
     time_t now;
     time_t then = time(NULL);
@@ -222,10 +227,28 @@ int main(int argc, char *argv[])
 
     u32_t buf_index = 0;
     
-    int rms_l, rms_r;
     int l = 0;
     int r = 0;
+
+    struct level_t level;
+    if (!level_init(&level, args.integration)) {
+        exit(-1);
+    }
+
+    struct ingest_t ingest;
+    ingest_init(&ingest, 10000000);
+
+    struct sched_t sched;
+    sched_init(&sched, args.fps);
+
+    struct metrics_t *metrics = offline ? NULL : metrics_open(argv[0]);
+
     while (vis_mmap->running) {
+        // wait until the next frame is due
+        prof_start();
+        sched_wait(&sched, &ingest, buf_index, 1);
+        prof_lap(PROF_WAIT);
+
 #ifdef USE_LOCKS
         // lock
         pthread_rwlock_rdlock(&vis_mmap->rwlock);
@@ -235,11 +258,11 @@ int main(int argc, char *argv[])
         bool have_new_data = (vis_mmap->buf_index != buf_index);
         if (have_new_data) {
             buf_index = vis_mmap->buf_index;
-            // calculate rms over buffer
-            calc_rms(vis_mmap->buffer, vis_mmap->buf_size / 2, &rms_l, &rms_r);
-            // average rms value
-            l += (rms_l - l) / 2;
-            r += (rms_r - r) / 2;
+            // take the new audio into the integration window and get the rms over it
+            level_feed(&level);
+            prof_lap(PROF_INGEST);
+            calc_rms(&level, &l, &r);
+            prof_lap(PROF_ANALYSE);
         }
         
 #ifdef USE_LOCKS
@@ -249,29 +272,52 @@ int main(int argc, char *argv[])
 
         // update led banner
         if (have_new_data) {
-            draw_vu(banner, l, r);
-            output(banner, sizeof(banner));
+            draw_vu(args.width, args.height, &banner[0][0], l, r);
+            prof_lap(PROF_RENDER);
+            output_frame(&banner[0][0], ingest_written(&ingest, buf_index));
+            prof_lap(PROF_OUTPUT);
+            sched_frame(&sched);
             fps++;
+        } else {
+            // send what is still waiting for the reader
+            output_flush();
         }
         
         // stats
         now = time(NULL);
         if (now != then) {
-            fprintf(stderr, "fps=%d\n", fps);
+            int wakeups, early, saved;
+            ingest_stats(&ingest, &wakeups, &early, &saved);
+            int jitter, jitter_max, late, skipped;
+            sched_stats(&sched, &jitter, &jitter_max, &late, &skipped);
+            int bytes, keyframes, dropped, partial;
+            output_stats(&bytes, &keyframes, &dropped, &partial);
+            fprintf(stderr, "fps=%d, wakeups=%d, early=%d, saved=%d, torn=%d, retries=%d, resyncs=%d, "
+                    "jitter=%d/%dus, late=%dus, skipped=%d, out=%dB/s, keyframes=%d, "
+                    "dropped=%d, partial=%d\n",
+                    fps, wakeups, early, saved, ring_stats.torn, ring_stats.retries, level.resyncs,
+                    jitter, jitter_max, late, skipped, bytes, keyframes,
+                    dropped, partial);
+            prof_dump(stderr);
             then = now;
             fps = 0;
             seconds++;
         }
 
+        metrics_publish(metrics, sched.total, output_dropped(), (l + r) / 2);
+
         // check max runtime
         if ((runtime > 0) && (seconds > runtime)) {
             break;
         }
-
-        // wait some time
-        usleep(10000);
     }
 
+    if (offline) {
+        offline_report(sched.total);
+    }
+    level_free(&level);
+    metrics_close(metrics);
+    output_close();
     return 0;
 }
 
@@ -0,0 +1,96 @@
+#include <stdio.h>      // fopen, fread, fprintf
+#include <stdlib.h>     // malloc
+#include <stdint.h>
+#include <string.h>     // memcmp
+
+#include "squeeze_vis.h"
+#include "wav.h"
+
+static uint32_t le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+// reads a 16-bit PCM WAV file into wav, as interleaved stereo, returns false if it cannot be read
+bool wav_read(const char *filename, struct wav_t *wav)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        perror("open failed");
+        return false;
+    }
+
+    uint8_t header[12];
+    if ((fread(header, sizeof(header), 1, f) != 1) || (memcmp(header, "RIFF", 4) != 0) ||
+        (memcmp(header + 8, "WAVE", 4) != 0)) {
+        fprintf(stderr, "%s: not a WAV file\n", filename);
+        fclose(f);
+        return false;
+    }
+
+    // walk the chunks until the data, the format must come before it
+    int channels = 0;
+    int bits = 0;
+    wav->rate = 0;
+    wav->samples = NULL;
+    uint8_t chunk[8];
+    while (fread(chunk, sizeof(chunk), 1, f) == 1) {
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if ((size < sizeof(fmt)) || (fread(fmt, sizeof(fmt), 1, f) != 1)) {
+                break;
+            }
+            int format = le16(fmt);
+            channels = le16(fmt + 2);
+            wav->rate = le32(fmt + 4);
+            bits = le16(fmt + 14);
+            if ((format != 1) || (bits != 16) || (channels < 1) || (channels > 2)) {
+                fprintf(stderr, "%s: only 16-bit PCM mono or stereo is supported\n", filename);
+                break;
+            }
+            fseek(f, size - sizeof(fmt) + (size & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (channels == 0) {
+                break;
+            }
+            wav->frames = size / (2 * channels);
+            wav->samples = (s16_t *)malloc(sizeof(s16_t) * 2 * wav->frames);
+            if (wav->samples == NULL) {
+                break;
+            }
+            uint8_t buf[4];
+            int i;
+            for (i = 0; i < wav->frames; i++) {
+                if (fread(buf, 2 * channels, 1, f) != 1) {
+                    // truncated file, keep what was there
+                    wav->frames = i;
+                    break;
+                }
+                wav->samples[2 * i] = (s16_t)le16(buf);
+                wav->samples[2 * i + 1] = (s16_t)le16(buf + 2 * (channels - 1));
+            }
+            fclose(f);
+            return true;
+        } else {
+            // skip other chunks, padded to an even size
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    fprintf(stderr, "%s: no usable audio data\n", filename);
+    free(wav->samples);
+    fclose(f);
+    return false;
+}
+
+void wav_free(struct wav_t *wav)
+{
+    free(wav->samples);
+    wav->samples = NULL;
+}
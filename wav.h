@@ -0,0 +1,23 @@
+/**
+ * Minimal reader for WAV files, for feeding recorded audio to the visualisations without squeezelite.
+ * Takes 16-bit PCM, mono or stereo, at any sample rate, and returns it as interleaved stereo, the way
+ * squeezelite stores it in the visualisation buffer.
+ **/
+
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdbool.h>
+
+#include "squeeze_vis.h"
+
+struct wav_t {
+    int rate;
+    int frames;         // number of stereo sample pairs
+    s16_t *samples;     // interleaved stereo
+};
+
+bool wav_read(const char *filename, struct wav_t *wav);
+void wav_free(struct wav_t *wav);
+
+#endif
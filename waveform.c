@@ -1,14 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>      // open
-
 #include <stdio.h>
-#include <sys/mman.h>   // MAP_FAILED
 
-#include <unistd.h>     // write
 
 #include <stdlib.h>     // exit
 #include <string.h>     // memcpy
@@ -16,100 +10,60 @@
 #include <math.h>       // sqrt
 
 #include "squeeze_vis.h"
+#include "ring.h"
+#include "ingest.h"
+#include "sched.h"
+#include "offline.h"
+#include "prof.h"
+#include "metrics.h"
+#include "geometry.h"
+#include "pool.h"
+#include "args.h"
+#include "output.h"
+#include "xcorr.h"
+#include "dsp.h"
+#include "cache.h"
+#include "mono.h"
 
 // whether to use the pthread lock
 //#define USE_LOCKS
 
-// led banner definitions
-#define WIDTH 80
-#define HEIGHT 8
-
-// number of audio samples used for one video frame
-#define AUDIO_FRAME   (16*WIDTH*2)
-
-// mmap the file
-static bool do_mmap(const char *filename)
-{
-    int vis_fd;
-    
-#if USE_LOCKS
-    vis_fd = open(filename, O_RDWR, 0666);
-#else
-    vis_fd = open(filename, O_RDONLY, 0);
-#endif
-    if (vis_fd <= 0) {
-        perror("open failed");
-        return false;
-    }
-
-#if USE_LOCKS
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ | PROT_WRITE, MAP_SHARED, vis_fd, 0);
-#else
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ, MAP_SHARED, vis_fd, 0);
-#endif
-	if (vis_mmap == MAP_FAILED) {
-        perror("mmap failed");
-        return false;
-	}
-
-	return true;
-}
-
-// outputs a frame to stdout
-static void output(uint8_t frame[HEIGHT][WIDTH][3], int size)
-{
-    write(1, frame, size);
-}
+// most audio samples used for one video frame: the snapshot of two frames stays within half of the ring
+#define MAX_AUDIO_FRAME (VIS_BUF_SIZE / 4)
 
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #define MAX(x,y) ((x)>(y)?(x):(y))
 
-// fixes an offset x in the visualisation buffer to the range 0..VIS_BUF_SIZE-1
-static int fix_offset(int offset)
-{
-    offset = (offset + VIS_BUF_SIZE) % VIS_BUF_SIZE;
-    if (offset < 0) {
-        offset += VIS_BUF_SIZE;
-    }
-    return offset;
-}
+// number of audio samples used for one video frame, 16 stereo samples per column up to MAX_AUDIO_FRAME, so
+// wider panels show fewer samples per column of the same stretch of audio
+static int audio_frame;
 
 // draws a waveform pixel, clipping the coordinate and saturating the colour as needed
-static void draw_pixel(uint8_t frame[HEIGHT][WIDTH], int sample, int x, int y)
+GEOMETRY_INLINE void draw_pixel(int width, int height, uint8_t frame[height][width], int sample, int x, int y,
+                                int inc)
 {
     int h;
     
-    h = (HEIGHT + sample - 1) / 2 + y;
+    h = (height + sample - 1) / 2 + y;
     h = MAX(h, 0);
-    h = MIN(h, HEIGHT - 1);
+    h = MIN(h, height - 1);
     
-    frame[h][x]++;
+    frame[h][x] += inc;
 }
 
 // finds the piece of audio in buf that best matches the audio in prv
-static int find_match(s16_t *prv, s16_t *buf)
+static int find_match(struct xcorr_t *xc, s16_t *prv, s16_t *buf)
 {
-    int i, j;
-    long int sum;
-    long int sum_max = 0;
-    int shift = 0;
-    int m1, m2;
-    // iterate over all shifts
-    for (i = 0; i < AUDIO_FRAME; i += 2) {
-        // integrate for cross-correlation
-        sum = 0;
-        for (j = 0; j < AUDIO_FRAME; j += 32) {
-            m1 = prv[j] + prv[j + 1];
-            m2 = buf[j + i] + buf[j + i + 1];
-            sum += (m1 * m2);
-        }
-        // keep track of max correlation
-        if (sum > sum_max) {
-            sum_max = sum;
-            shift = i;
-        }
+    // convert both to mono for the correlation
+    int i;
+    for (i = 0; i < xc->len; i++) {
+        xc->ref[i] = prv[2 * i] + prv[2 * i + 1];
     }
-    return shift;
+    for (i = 0; i < 2 * xc->len; i++) {
+        xc->sig[i] = buf[2 * i] + buf[2 * i + 1];
+    }
+    // shift is in stereo samples
+    return 2 * xcorr_best_shift(xc);
 }
 
 // render one pixel from intensity to an RGB value
@@ -135,24 +89,54 @@ static void render_pixel(int i, uint8_t pixel[3])
         {15, 15, 15}
     };
     
+    i = MIN(i, 16);
     pixel[0] = 16 * palet[i][0];
     pixel[1] = 16 * palet[i][1];
     pixel[2] = 16 * palet[i][2];
 }
 
+// a frame being rendered, shared by the threads rendering its rows
+struct draw_t {
+    int width;
+    int height;
+    uint8_t *frame;
+    const uint8_t *intensity;
+};
+
+// renders rows start..end-1 of the intensity map to colour
+GEOMETRY_INLINE void render_rows(int width, int height, uint8_t frame[height][width][3],
+                                 const uint8_t intensity[height][width], int start, int end)
+{
+    int x, y;
+    for (y = start; y < end; y++) {
+        for (x = 0; x < width; x++) {
+            render_pixel(intensity[y][x], frame[y][x]);
+        }
+    }
+}
+
+static void render_job(void *ctx, int start, int end)
+{
+    struct draw_t *d = ctx;
+    GEOMETRY_CALL(d->width, d->height, render_rows, (void *)d->frame, (const void *)d->intensity, start, end);
+}
+
 // draws a waveform
-static int draw_wave(uint8_t frame[HEIGHT][WIDTH][3], s16_t *buf, int rms_avg)
+GEOMETRY_INLINE int draw_wave(int width, int height, uint8_t frame[height][width][3], s16_t *buf,
+                              struct xcorr_t *xc, int rms_avg)
 {
-    static s16_t prv[AUDIO_FRAME];
-    uint8_t intensity[HEIGHT][WIDTH];
+    static s16_t prv[MAX_AUDIO_FRAME];
+    static uint8_t intensity_buf[GEOMETRY_MAX_PIXELS];
+    uint8_t (*intensity)[width] = (void *)intensity_buf;
 
     // find best shift that matches the previous waveform to the current one
     int shift;
-    shift = find_match(prv, buf);
+    shift = find_match(xc, prv, buf);
+    prof_lap(PROF_ANALYSE);
     
     // copy matched buffer
     int j;
-    for (j = 0; j < AUDIO_FRAME; j += 2) {
+    for (j = 0; j < audio_frame; j += 2) {
         prv[j] = buf[j + shift];
         prv[j + 1] = buf[j + shift + 1];
     }
@@ -160,82 +144,124 @@ static int draw_wave(uint8_t frame[HEIGHT][WIDTH][3], s16_t *buf, int rms_avg)
     // draw as intensity map
     int l, r, m, h;
     int i;
-    memset(intensity, 0, sizeof(intensity));
-    int scale = (1 << 25) / rms_avg;
-    for (i = 0; i < AUDIO_FRAME; i += 2) {
+    memset(intensity, 0, width * height);
+    int scale = (height << 22) / rms_avg;
+    // a full column is as bright as with 16 samples per column
+    int inc = MAX((16 * width + audio_frame / 4) / (audio_frame / 2), 1);
+    for (i = 0; i < audio_frame; i += 2) {
         l = prv[i];
         r = prv[i + 1];
         m = r + l;
         h = (m * scale) >> 16;
-        draw_pixel(intensity, h, i / 32, 0);
+        draw_pixel(width, height, intensity, h, (i / 2) * width / (audio_frame / 2), 0, inc);
     }
     
-    // render intensity to color
-    int x, y;
-    for (y = 0; y < HEIGHT; y++) {
-        for (x = 0; x < WIDTH; x++) {
-            render_pixel(intensity[y][x], frame[y][x]);
-        }
-    }
+    // render intensity to color, split in rows over the threads
+    static struct draw_t d;
+    d.width = width;
+    d.height = height;
+    d.frame = &frame[0][0][0];
+    d.intensity = intensity_buf;
+    pool_run(render_job, &d, height);
 
     // calculate RMS of left and right signal
-    long int sum = 0;
-    for (j = 0; j < AUDIO_FRAME; j++) {
-        m = prv[j];
-        sum += (m * m);
-    }
-    int rms = sqrt(sum / AUDIO_FRAME);
+    int64_t sum_l, sum_r;
+    dsp_sum_squares_stereo(prv, audio_frame / 2, &sum_l, &sum_r);
+    int rms = sqrt((sum_l + sum_r) / audio_frame);
     return rms;
 }
 
-static uint8_t banner[HEIGHT][WIDTH][3];
-static s16_t buffer[VIS_BUF_SIZE];
+static uint8_t banner[GEOMETRY_MAX_PIXELS][3];
+static s16_t buffer[2 * MAX_AUDIO_FRAME];
 
-// argv[1] = name of /dev/shm file created by squeezelite
-// argv[2] = number of seconds to run (if not present: forever)
+// usage: waveform [-r fps] [-e encoding] [-f format] [-d dither] [-o file] [-i wav file] [-g geometry] [-j threads]
+//                 [shm file] [seconds]
+// shm file = name of /dev/shm file created by squeezelite
+// seconds = number of seconds to run (if not present: forever)
 int main(int argc, char *argv[])
 {
+    int64_t t_start = mono_ns();
+
     time_t now;
     time_t then = time(NULL);
     int fps = 0;
     
     int rms_avg = 1;
 
-    // mmap file
-    const char *filename = "/dev/shm/squeezelite-00:21:00:02:cc:45";
-    if (argc > 1) {
-        filename = argv[1];
+    struct args_t args = {
+        .options = "r:e:f:d:o:i:g:j:",
+        .filename = "/dev/shm/squeezelite-00:21:00:02:cc:45",
+        .runtime = 0,
+        .fps = 0,
+    };
+    args_parse(&args, argc, argv);
+
+    // mmap file, or play a WAV file into a private buffer
+#ifdef USE_LOCKS
+    // taking the rwlock needs a writable mapping
+    bool writable = true;
+#else
+    bool writable = false;
+#endif
+    if ((args.input != NULL) ? !offline_open(args.input) : !vis_open(args.filename, writable)) {
+        exit(-1);
+    }
+    if (!output_init(args.encoding, args.format, args.dither, args.width, args.height, args.output)) {
+        exit(-1);
     }
-    if (!do_mmap(filename)) {
+    if (!pool_init(args.threads, args.width * args.height)) {
         exit(-1);
     }
+    if (offline) {
+        output_blocking();
+    }
 
     // max runtime
     int seconds = 0;
-    int runtime = 0;
-    if (argc > 2) {
-        runtime = atoi(argv[2]);
-    }
+    int runtime = args.runtime;
     
+    // cross-correlation over one frame of mono samples
+    audio_frame = MIN(16 * 2 * args.width, MAX_AUDIO_FRAME);
+    struct xcorr_t xcorr;
+    if (!xcorr_init(&xcorr, audio_frame / 2)) {
+        fprintf(stderr, "xcorr_init failed\n");
+        exit(-1);
+    }
+    cache_wisdom_save();
+
     u32_t buf_index = 0;
-    
+    int64_t t_init = mono_ns();
+    bool first_frame = true;
+
+    struct ingest_t ingest;
+    ingest_init(&ingest, 1000000);
+
+    struct sched_t sched;
+    sched_init(&sched, args.fps);
+
+    struct metrics_t *metrics = offline ? NULL : metrics_open(argv[0]);
+
     while (vis_mmap->running) {
+        // wait until the next frame is due
+        prof_start();
+        sched_wait(&sched, &ingest, buf_index, audio_frame);
+        prof_lap(PROF_WAIT);
+
 #ifdef USE_LOCKS
         // lock
         pthread_rwlock_rdlock(&vis_mmap->rwlock);
 #endif
 
         // check for data available
-        int avail = fix_offset(vis_mmap->buf_index - buf_index);
-        bool have_new_data = (avail >= AUDIO_FRAME);
+        int avail = ring_avail(buf_index);
+        bool have_new_data = (avail >= audio_frame);
         if (have_new_data) {
-            // unwrap buffer
-            int i;
-            for (i = 0; i < VIS_BUF_SIZE; i++) {
-                buffer[i] = vis_mmap->buffer[fix_offset(buf_index + i - AUDIO_FRAME)];
-            }
-            // update our read index
-            buf_index = fix_offset(buf_index + AUDIO_FRAME);
+            // take a tear-free snapshot of the audio around our read index, and update our read index,
+            // skipping to the newest audio when a fixed frame rate lets us fall more than a frame behind
+            u32_t end = buf_index + ((avail >= 2 * audio_frame) ? avail : audio_frame);
+            have_new_data = (ring_snapshot(&end, 2 * audio_frame, 2 * audio_frame, buffer) > 0);
+            buf_index = ring_fix(end);
+            prof_lap(PROF_INGEST);
         }
 
 #ifdef USE_LOCKS
@@ -245,34 +271,59 @@ int main(int argc, char *argv[])
 
         // update led banner
         if (have_new_data) {
-            memset(banner, 0, sizeof(banner));
-            int rms = 256 * draw_wave(banner, buffer, rms_avg);
+            int rms = 256 * GEOMETRY_CALL(args.width, args.height, draw_wave, (void *)banner, buffer, &xcorr, rms_avg);
+            prof_lap(PROF_RENDER);
 
             // smooth rms over time
             rms_avg += (rms - rms_avg + 16) / 32;
 
-            output(banner, sizeof(banner));
+            output_frame(&banner[0][0], ingest_written(&ingest, buf_index));
+            prof_lap(PROF_OUTPUT);
+            sched_frame(&sched);
+            if (first_frame) {
+                cache_report_startup(t_init - t_start, mono_ns() - t_start, "none");
+                first_frame = false;
+            }
             fps++;
+        } else {
+            // send what is still waiting for the reader
+            output_flush();
         }
         
         // stats
         now = time(NULL);
         if (now != then) {
-            fprintf(stderr, "fps=%d, rms=%6d\n", fps, rms_avg);
+            int wakeups, early, saved;
+            ingest_stats(&ingest, &wakeups, &early, &saved);
+            int jitter, jitter_max, late, skipped;
+            sched_stats(&sched, &jitter, &jitter_max, &late, &skipped);
+            int bytes, keyframes, dropped, partial;
+            output_stats(&bytes, &keyframes, &dropped, &partial);
+            fprintf(stderr, "fps=%d, rms=%6d, wakeups=%d, early=%d, saved=%d, torn=%d, retries=%d, "
+                    "jitter=%d/%dus, late=%dus, skipped=%d, out=%dB/s, keyframes=%d, "
+                    "dropped=%d, partial=%d\n",
+                    fps, rms_avg, wakeups, early, saved, ring_stats.torn, ring_stats.retries,
+                    jitter, jitter_max, late, skipped, bytes, keyframes,
+                    dropped, partial);
+            prof_dump(stderr);
             then = now;
             fps = 0;
             seconds++;
         }
 
+        metrics_publish(metrics, sched.total, output_dropped(), rms_avg);
+
         // check max runtime
         if ((runtime > 0) && (seconds > runtime)) {
             break;
         }
-
-        // wait some time
-        usleep(1000);
     }
 
+    if (offline) {
+        offline_report(sched.total);
+    }
+    metrics_close(metrics);
+    output_close();
     return 0;
 }
 
@@ -1,14 +1,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>      // open
-
 #include <stdio.h>
-#include <sys/mman.h>   // MAP_FAILED
 
-#include <unistd.h>     // write
 
 #include <stdlib.h>     // exit
 #include <string.h>     // memcpy
@@ -16,50 +10,26 @@
 #include <math.h>       // sqrt
 
 #include "squeeze_vis.h"
+#include "ring.h"
+#include "ingest.h"
+#include "sched.h"
+#include "offline.h"
+#include "prof.h"
+#include "metrics.h"
+#include "geometry.h"
+#include "pool.h"
+#include "args.h"
+#include "output.h"
+#include "xcorr.h"
+#include "dsp.h"
+#include "cache.h"
+#include "mono.h"
 
 // whether to use the pthread lock
 //#define USE_LOCKS
 
-// led banner definitions
-#define WIDTH 80
-#define HEIGHT 8
-
-#define BUF_SIZE    (16*WIDTH)
-#define AUDIO_FRAME (2*BUF_SIZE)
-
-// mmap the file
-static bool do_mmap(const char *filename)
-{
-    int vis_fd;
-    
-#if USE_LOCKS
-    vis_fd = open(filename, O_RDWR, 0666);
-#else
-    vis_fd = open(filename, O_RDONLY, 0);
-#endif
-    if (vis_fd <= 0) {
-        perror("open failed");
-        return false;
-    }
-
-#if USE_LOCKS
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ | PROT_WRITE, MAP_SHARED, vis_fd, 0);
-#else
-    vis_mmap = (struct vis_t *)mmap(0, sizeof(struct vis_t), PROT_READ, MAP_SHARED, vis_fd, 0);
-#endif
-	if (vis_mmap == MAP_FAILED) {
-        perror("mmap failed");
-        return false;
-	}
-
-	return true;
-}
-
-// outputs a frame to stdout
-static void output(uint8_t frame[HEIGHT][WIDTH][3], int size)
-{
-    write(1, frame, size);
-}
+// most mono samples used for one video frame: the snapshot of two frames stays within half of the ring
+#define MAX_BUF_SIZE    (VIS_BUF_SIZE / 8)
 
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #define MAX(x,y) ((x)>(y)?(x):(y))
@@ -74,72 +44,83 @@ typedef struct {
     rgb_t   c[17];
 } palet_t;
 
-// fixes an offset x in the visualisation buffer to the range 0..VIS_BUF_SIZE-1
-static int fix_offset(int offset)
-{
-    offset = (offset + VIS_BUF_SIZE) % VIS_BUF_SIZE;
-    if (offset < 0) {
-        offset += VIS_BUF_SIZE;
-    }
-    return offset;
-}
+// mono samples used for one video frame, 16 per column up to MAX_BUF_SIZE, so wider panels show fewer samples per
+// column of the same stretch of audio, and the stereo audio samples they are made from
+static int buf_size;
+static int audio_frame;
 
 // draws a waveform pixel, clipping the coordinate and saturating the colour as needed
-static void draw_pixel(uint8_t frame[HEIGHT][WIDTH], int sample, int x)
+GEOMETRY_INLINE void draw_pixel(int width, int height, uint8_t frame[height][width], int sample, int x, int inc)
 {
     int h;
     
-    h = (HEIGHT + sample - 1) / 2;
+    h = (height + sample - 1) / 2;
     h = MAX(h, 0);
-    h = MIN(h, HEIGHT - 1);
+    h = MIN(h, height - 1);
     
-    frame[h][x]++;
+    frame[h][x] += inc;
 }
 
 // finds the piece of audio in buf that best matches the audio in prv
-static int find_match(double *prv, double *buf)
+static int find_match(struct xcorr_t *xc, double *prv, double *buf)
 {
-    int i, j;
-    double sum;
-    double sum_max = 0;
-    int shift = 0;
-    // iterate over all shifts
-    for (i = 0; i < BUF_SIZE; i++) {
-        // integrate for cross-correlation
-        sum = 0;
-        for (j = 0; j < BUF_SIZE; j += 16) {
-            sum += prv[j] * buf[i + j];
-        }
-        // keep track of max correlation
-        if (sum > sum_max) {
-            sum_max = sum;
-            shift = i;
-        }
-    }
-    return shift;
+    memcpy(xc->ref, prv, sizeof(double) * xc->len);
+    memcpy(xc->sig, buf, sizeof(double) * 2 * xc->len);
+    return xcorr_best_shift(xc);
 }
 
 // render one pixel from intensity to an RGB value
 static void render_pixel(palet_t *palet, int i, uint8_t pixel[3])
 {
+    i = MIN(i, 16);
     pixel[0] = palet->c[i].r;
     pixel[1] = palet->c[i].g;
     pixel[2] = palet->c[i].b;
 }
 
+// a frame being rendered, shared by the threads rendering its rows
+struct draw_t {
+    int width;
+    int height;
+    uint8_t *frame;
+    const uint8_t *intensity;
+    palet_t *palet;
+};
+
+// renders rows start..end-1 of the intensity map to colour
+GEOMETRY_INLINE void render_rows(int width, int height, uint8_t frame[height][width][3],
+                                 const uint8_t intensity[height][width], palet_t *palet, int start, int end)
+{
+    int x, y;
+    for (y = start; y < end; y++) {
+        for (x = 0; x < width; x++) {
+            render_pixel(palet, intensity[y][x], frame[y][x]);
+        }
+    }
+}
+
+static void render_job(void *ctx, int start, int end)
+{
+    struct draw_t *d = ctx;
+    GEOMETRY_CALL(d->width, d->height, render_rows, (void *)d->frame, (const void *)d->intensity, d->palet, start, end);
+}
+
 // draws a waveform
-static double draw_wave(uint8_t frame[HEIGHT][WIDTH][3], double *buf, palet_t *palet, double rms_avg)
+GEOMETRY_INLINE double draw_wave(int width, int height, uint8_t frame[height][width][3], double *buf,
+                                 struct xcorr_t *xc, palet_t *palet, double rms_avg)
 {
-    static double prv[BUF_SIZE];
-    uint8_t intensity[HEIGHT][WIDTH];
+    static double prv[MAX_BUF_SIZE];
+    static uint8_t intensity_buf[GEOMETRY_MAX_PIXELS];
+    uint8_t (*intensity)[width] = (void *)intensity_buf;
 
     // find best shift that matches the previous waveform to the current one
     int shift;
-    shift = find_match(prv, buf);
+    shift = find_match(xc, prv, buf);
+    prof_lap(PROF_ANALYSE);
     
     // copy matched buffer
     int j;
-    for (j = 0; j < BUF_SIZE; j++) {
+    for (j = 0; j < buf_size; j++) {
         prv[j] = buf[j + shift];
     }
 
@@ -147,34 +128,34 @@ static double draw_wave(uint8_t frame[HEIGHT][WIDTH][3], double *buf, palet_t *p
     int h;
     double m;
     int i;
-    memset(intensity, 0, sizeof(intensity));
-    double scale = 3.0 / rms_avg;
-    for (i = 0; i < BUF_SIZE; i++) {
+    memset(intensity, 0, width * height);
+    double scale = 3.0 * height / 8 / rms_avg;
+    // a full column is as bright as with 16 samples per column
+    int inc = MAX((16 * width + buf_size / 2) / buf_size, 1);
+    for (i = 0; i < buf_size; i++) {
         m = prv[i];
         h = m * scale;
-        draw_pixel(intensity, h, i / 16);
+        draw_pixel(width, height, intensity, h, i * width / buf_size, inc);
     }
     
-    // render intensity to color
-    int x, y;
-    for (y = 0; y < HEIGHT; y++) {
-        for (x = 0; x < WIDTH; x++) {
-            render_pixel(palet, intensity[y][x], frame[y][x]);
-        }
-    }
+    // render intensity to color, split in rows over the threads
+    static struct draw_t d;
+    d.width = width;
+    d.height = height;
+    d.frame = &frame[0][0][0];
+    d.intensity = intensity_buf;
+    d.palet = palet;
+    pool_run(render_job, &d, height);
 
     // calculate RMS of left and right signal
-    double sum = 0.0;
-    for (j = 0; j < BUF_SIZE; j++) {
-        m = prv[j];
-        sum += (m * m);
-    }
-    double rms = sqrt(sum / BUF_SIZE);
+    double sum = dsp_sum_squares(prv, buf_size);
+    double rms = sqrt(sum / buf_size);
     return rms;
 }
 
-static uint8_t banner[HEIGHT][WIDTH][3];
-static double buffer[2*BUF_SIZE];
+static uint8_t banner[GEOMETRY_MAX_PIXELS][3];
+static double buffer[2 * MAX_BUF_SIZE];
+static s16_t snapshot[4 * MAX_BUF_SIZE];
 
 // limits x to the range [min,max]
 static int limit(int x, int min, int max)
@@ -203,60 +184,110 @@ static void create_palet(palet_t *pal, rgb_t col, double scale)
    }
 }
 
-// argv[1] = name of /dev/shm file created by squeezelite
-// argv[2] = number of seconds to run (if not present: forever)
+// usage: waveformf [-r fps] [-e encoding] [-f format] [-d dither] [-o file] [-i wav file] [-g geometry] [-j threads]
+//                  [shm file] [seconds]
+// shm file = name of /dev/shm file created by squeezelite
+// seconds = number of seconds to run (if not present: forever)
 int main(int argc, char *argv[])
 {
+    int64_t t_start = mono_ns();
+
     time_t now;
     time_t then = time(NULL);
     int fps = 0;
     
     double rms_avg = 1.0;
 
-    // mmap file
-    const char *filename = "/dev/shm/squeezelite-00:21:00:02:cc:45";
-    if (argc > 1) {
-        filename = argv[1];
+    struct args_t args = {
+        .options = "r:e:f:d:o:i:g:j:",
+        .filename = "/dev/shm/squeezelite-00:21:00:02:cc:45",
+        .runtime = 0,
+        .fps = 0,
+    };
+    args_parse(&args, argc, argv);
+
+    // mmap file, or play a WAV file into a private buffer
+#ifdef USE_LOCKS
+    // taking the rwlock needs a writable mapping
+    bool writable = true;
+#else
+    bool writable = false;
+#endif
+    if ((args.input != NULL) ? !offline_open(args.input) : !vis_open(args.filename, writable)) {
+        exit(-1);
     }
-    if (!do_mmap(filename)) {
+    if (!output_init(args.encoding, args.format, args.dither, args.width, args.height, args.output)) {
         exit(-1);
     }
+    if (!pool_init(args.threads, args.width * args.height)) {
+        exit(-1);
+    }
+    if (offline) {
+        output_blocking();
+    }
 
     // max runtime
     int seconds = 0;
-    int runtime = 0;
-    if (argc > 2) {
-        runtime = atoi(argv[2]);
-    }
+    int runtime = args.runtime;
     
-    // create a palet
+    // create a palet, a random one except offline, where the frames must be the same on every run
     palet_t palet;
-    srand(time(NULL));
+    srandom(offline ? 1 : time(NULL));
     uint8_t r = random() & 255;
     uint8_t g = random() & 255;
     uint8_t b = random() & 255;
     create_palet(&palet, (rgb_t){r, g, b}, 1000.0 / (r + g + b + 1));
     
+    // cross-correlation over one frame of mono samples
+    buf_size = MIN(16 * args.width, MAX_BUF_SIZE);
+    audio_frame = 2 * buf_size;
+    struct xcorr_t xcorr;
+    if (!xcorr_init(&xcorr, buf_size)) {
+        fprintf(stderr, "xcorr_init failed\n");
+        exit(-1);
+    }
+    cache_wisdom_save();
+
     u32_t buf_index = 0;
-    
+    int64_t t_init = mono_ns();
+    bool first_frame = true;
+
+    struct ingest_t ingest;
+    ingest_init(&ingest, 1000000);
+
+    struct sched_t sched;
+    sched_init(&sched, args.fps);
+
+    struct metrics_t *metrics = offline ? NULL : metrics_open(argv[0]);
+
     while (vis_mmap->running) {
+        // wait until the next frame is due
+        prof_start();
+        sched_wait(&sched, &ingest, buf_index, audio_frame);
+        prof_lap(PROF_WAIT);
+
 #ifdef USE_LOCKS
         // lock
         pthread_rwlock_rdlock(&vis_mmap->rwlock);
 #endif
 
         // check for data available
-        int avail = fix_offset(vis_mmap->buf_index - buf_index);
-        bool have_new_data = (avail >= AUDIO_FRAME);
+        int avail = ring_avail(buf_index);
+        bool have_new_data = (avail >= audio_frame);
+        if (have_new_data) {
+            // take a tear-free snapshot of the audio around our read index, and update our read index,
+            // skipping to the newest audio when a fixed frame rate lets us fall more than a frame behind
+            u32_t end = buf_index + ((avail >= 2 * audio_frame) ? avail : audio_frame);
+            have_new_data = (ring_snapshot(&end, 2 * audio_frame, 2 * audio_frame, snapshot) > 0);
+            buf_index = ring_fix(end);
+        }
         if (have_new_data) {
-            // unwrap buffer, convert to mono double
+            // convert to mono double
             int i;
-            for (i = 0; i < (2 * AUDIO_FRAME); i += 2) {
-                int index = fix_offset(buf_index + i - AUDIO_FRAME);
-                buffer[i / 2] = (vis_mmap->buffer[index] + vis_mmap->buffer[index + 1]) / 2;
+            for (i = 0; i < (2 * audio_frame); i += 2) {
+                buffer[i / 2] = (snapshot[i] + snapshot[i + 1]) / 2;
             }
-            // update our read index
-            buf_index = fix_offset(buf_index + AUDIO_FRAME);
+            prof_lap(PROF_INGEST);
         }
 
 #ifdef USE_LOCKS
@@ -266,34 +297,60 @@ int main(int argc, char *argv[])
 
         // update led banner
         if (have_new_data) {
-            memset(banner, 0, sizeof(banner));
-            double rms = draw_wave(banner, buffer, &palet, rms_avg);
+            double rms = GEOMETRY_CALL(args.width, args.height, draw_wave, (void *)banner, buffer, &xcorr, &palet,
+                                       rms_avg);
+            prof_lap(PROF_RENDER);
 
             // smooth rms over time
             rms_avg += (rms - rms_avg) / 64.0;
 
-            output(banner, sizeof(banner));
+            output_frame(&banner[0][0], ingest_written(&ingest, buf_index));
+            prof_lap(PROF_OUTPUT);
+            sched_frame(&sched);
+            if (first_frame) {
+                cache_report_startup(t_init - t_start, mono_ns() - t_start, "none");
+                first_frame = false;
+            }
             fps++;
+        } else {
+            // send what is still waiting for the reader
+            output_flush();
         }
         
         // stats
         now = time(NULL);
         if (now != then) {
-            fprintf(stderr, "fps=%d, rms=%.6f\n", fps, rms_avg);
+            int wakeups, early, saved;
+            ingest_stats(&ingest, &wakeups, &early, &saved);
+            int jitter, jitter_max, late, skipped;
+            sched_stats(&sched, &jitter, &jitter_max, &late, &skipped);
+            int bytes, keyframes, dropped, partial;
+            output_stats(&bytes, &keyframes, &dropped, &partial);
+            fprintf(stderr, "fps=%d, rms=%.6f, wakeups=%d, early=%d, saved=%d, torn=%d, retries=%d, "
+                    "jitter=%d/%dus, late=%dus, skipped=%d, out=%dB/s, keyframes=%d, "
+                    "dropped=%d, partial=%d\n",
+                    fps, rms_avg, wakeups, early, saved, ring_stats.torn, ring_stats.retries,
+                    jitter, jitter_max, late, skipped, bytes, keyframes,
+                    dropped, partial);
+            prof_dump(stderr);
             then = now;
             fps = 0;
             seconds++;
         }
 
+        metrics_publish(metrics, sched.total, output_dropped(), rms_avg);
+
         // check max runtime
         if ((runtime > 0) && (seconds > runtime)) {
             break;
         }
-
-        // wait some time
-        usleep(1000);
     }
 
+    if (offline) {
+        offline_report(sched.total);
+    }
+    metrics_close(metrics);
+    output_close();
     return 0;
 }
 
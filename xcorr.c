@@ -0,0 +1,82 @@
+#include <string.h>     // memset
+
+#include "fftw3.h"
+
+#include "xcorr.h"
+#include "cache.h"
+
+// allocates buffers and creates the fft plans for correlating len samples over len shifts
+bool xcorr_init(struct xcorr_t *xc, int len)
+{
+    int n = 1;
+    while (n < 2 * len) {
+        n *= 2;
+    }
+    xc->len = len;
+    xc->n = n;
+
+    xc->ref = (double*) fftw_malloc(sizeof(double) * n);
+    xc->sig = (double*) fftw_malloc(sizeof(double) * n);
+    xc->corr = (double*) fftw_malloc(sizeof(double) * n);
+    xc->fref = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    xc->fsig = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (n / 2 + 1));
+    if (!xc->ref || !xc->sig || !xc->corr || !xc->fref || !xc->fsig) {
+        return false;
+    }
+
+    xc->plan_ref = cache_plan_r2c(n, xc->ref, xc->fref);
+    xc->plan_sig = cache_plan_r2c(n, xc->sig, xc->fsig);
+    xc->plan_inv = cache_plan_c2r(n, xc->fsig, xc->corr);
+    if (!xc->plan_ref || !xc->plan_sig || !xc->plan_inv) {
+        return false;
+    }
+
+    // planning overwrites the buffers, the zero padding is set up afterwards
+    memset(xc->ref, 0, sizeof(double) * n);
+    memset(xc->sig, 0, sizeof(double) * n);
+    return true;
+}
+
+// correlates ref against sig, returns the shift (0..len-1) with the highest positive correlation
+int xcorr_best_shift(struct xcorr_t *xc)
+{
+    fftw_execute(xc->plan_ref);
+    fftw_execute(xc->plan_sig);
+
+    // multiply the signal spectrum by the complex conjugate of the reference spectrum
+    int k;
+    for (k = 0; k <= xc->n / 2; k++) {
+        double rr = xc->fref[k][0];
+        double ri = xc->fref[k][1];
+        double sr = xc->fsig[k][0];
+        double si = xc->fsig[k][1];
+        xc->fsig[k][0] = rr * sr + ri * si;
+        xc->fsig[k][1] = rr * si - ri * sr;
+    }
+    fftw_execute(xc->plan_inv);
+
+    // keep track of max correlation
+    int i;
+    int shift = 0;
+    double sum_max = 0.0;
+    for (i = 0; i < xc->len; i++) {
+        if (xc->corr[i] > sum_max) {
+            sum_max = xc->corr[i];
+            shift = i;
+        }
+    }
+    return shift;
+}
+
+// frees the plans and buffers
+void xcorr_free(struct xcorr_t *xc)
+{
+    fftw_destroy_plan(xc->plan_ref);
+    fftw_destroy_plan(xc->plan_sig);
+    fftw_destroy_plan(xc->plan_inv);
+    fftw_free(xc->ref);
+    fftw_free(xc->sig);
+    fftw_free(xc->corr);
+    fftw_free(xc->fref);
+    fftw_free(xc->fsig);
+}
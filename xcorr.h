@@ -0,0 +1,35 @@
+/**
+ * Cross-correlation engine, used by the waveform displays to find the shift of the new audio that best
+ * matches the previously displayed waveform.
+ *
+ * The full-resolution correlation of 'len' reference samples against all 'len' shifts of a signal of
+ * 2 * 'len' samples is calculated through FFTW in O(N log N), with N the power of two >= 2 * 'len',
+ * so there is no circular wrap-around.
+ **/
+
+#ifndef XCORR_H
+#define XCORR_H
+
+#include <stdbool.h>
+
+#include "fftw3.h"
+
+struct xcorr_t {
+    int len;                // number of reference samples and number of shifts
+    int n;                  // fft size
+    double *ref;            // len reference samples, filled in by the caller
+    double *sig;            // 2 * len signal samples, filled in by the caller
+    double *corr;           // correlation for each shift
+    fftw_complex *fref;
+    fftw_complex *fsig;
+    fftw_plan plan_ref;
+    fftw_plan plan_sig;
+    fftw_plan plan_inv;
+};
+
+bool xcorr_init(struct xcorr_t *xc, int len);
+int xcorr_best_shift(struct xcorr_t *xc);
+void xcorr_free(struct xcorr_t *xc);
+
+#endif
+